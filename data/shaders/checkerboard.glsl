@@ -0,0 +1,11 @@
+#ifdef GL_ES
+precision mediump float;
+#endif
+varying vec4 varying_color;
+varying vec2 varying_texcoord;
+
+void main() {
+	// texcoords are in pixels, the colour goes on every other pixel of every other row
+	vec2 odd = mod(floor(varying_texcoord), 2.0);
+	gl_FragColor = (odd.x + odd.y < 0.5) ? varying_color : vec4(0.0);
+}
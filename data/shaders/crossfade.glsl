@@ -0,0 +1,15 @@
+#ifdef GL_ES
+precision mediump float;
+#endif
+uniform sampler2D al_tex;
+uniform float fade;
+uniform vec2 next_offset;
+varying vec4 varying_color;
+varying vec2 varying_texcoord;
+
+void main() {
+	// the next layer over the faded out previous one, as premultiplied alpha blending would do it
+	vec4 prev = texture2D(al_tex, varying_texcoord) * (1.0 - fade);
+	vec4 next = texture2D(al_tex, varying_texcoord + next_offset);
+	gl_FragColor = (next + prev * (1.0 - next.a)) * varying_color;
+}
@@ -0,0 +1,18 @@
+#ifdef GL_ES
+precision mediump float;
+#endif
+uniform sampler2D al_tex;
+uniform sampler2D palette;
+uniform bool twice; // blend each pixel over itself, see twice.glsl
+varying vec4 varying_color;
+varying vec2 varying_texcoord;
+
+void main() {
+	// al_tex holds palette indices normalized to 0..1, palette is a 256x1 texture
+	float index = texture2D(al_tex, varying_texcoord).r * 255.0;
+	vec4 color = texture2D(palette, vec2((index + 0.5) / 256.0, 0.5)) * varying_color;
+	if (twice) {
+		color *= 2.0 - color.a;
+	}
+	gl_FragColor = color;
+}
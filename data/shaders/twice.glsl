@@ -0,0 +1,12 @@
+#ifdef GL_ES
+precision mediump float;
+#endif
+uniform sampler2D al_tex;
+varying vec4 varying_color;
+varying vec2 varying_texcoord;
+
+void main() {
+	// the same pixel blended over itself with premultiplied alpha
+	vec4 color = texture2D(al_tex, varying_texcoord) * varying_color;
+	gl_FragColor = color * (2.0 - color.a);
+}
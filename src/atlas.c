@@ -0,0 +1,156 @@
+/*! \file atlas.c
+ *  \brief Texture atlases packed at build time by tools/atlaspack.c.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "atlas.h"
+#include "common.h"
+#include "layers.h"
+#include <libsuperderpy.h>
+#include <stdio.h>
+
+static int GetValue(ALLEGRO_CONFIG* config, const char* section, const char* key) {
+	const char* value = al_get_config_value(config, section, key);
+	return value ? atoi(value) : 0;
+}
+
+struct Atlas* LoadAtlas(struct Game* game, const char* manifest) {
+	// Returns NULL when there's no manifest (e.g. the atlases weren't built),
+	// so the caller can fall back to loading the individual files.
+	char* path = FindDataFilePath(game, manifest);
+	if (!path) {
+		return NULL;
+	}
+	ALLEGRO_CONFIG* config = al_load_config_file(path);
+	free(path);
+	if (!config) {
+		return NULL;
+	}
+
+	struct Atlas* atlas = calloc(1, sizeof(struct Atlas));
+	atlas->pagecount = GetValue(config, "atlas", "pages");
+	atlas->pages = calloc(atlas->pagecount, sizeof(struct PalettedBitmap*));
+
+	char dir[255] = "";
+	const char* slash = strrchr(manifest, '/');
+	if (slash) {
+		snprintf(dir, 255, "%.*s", (int)(slash - manifest + 1), manifest);
+	}
+	for (int i = 0; i < atlas->pagecount; i++) {
+		char filename[255];
+		snprintf(filename, 255, "%satlas%d.png", dir, i);
+		atlas->pages[i] = LoadPalettedBitmap(game, filename);
+	}
+
+	void* iterator;
+	for (const char* section = al_get_first_config_section(config, &iterator); section; section = al_get_next_config_section(&iterator)) {
+		if (strcmp(section, "") != 0 && strcmp(section, "atlas") != 0) {
+			atlas->count++;
+		}
+	}
+	atlas->sprites = calloc(atlas->count, sizeof(struct AtlasSprite));
+
+	int i = 0;
+	for (const char* section = al_get_first_config_section(config, &iterator); section; section = al_get_next_config_section(&iterator)) {
+		if (strcmp(section, "") == 0 || strcmp(section, "atlas") == 0) {
+			continue;
+		}
+		struct AtlasSprite* sprite = &atlas->sprites[i++];
+		sprite->name = strdup(section);
+		sprite->page = GetValue(config, section, "page");
+		sprite->offsetx = GetValue(config, section, "ox");
+		sprite->offsety = GetValue(config, section, "oy");
+		sprite->width = GetValue(config, section, "width");
+		sprite->height = GetValue(config, section, "height");
+		sprite->bitmap = al_create_sub_bitmap(atlas->pages[sprite->page]->bitmap,
+			GetValue(config, section, "x"), GetValue(config, section, "y"),
+			GetValue(config, section, "w"), GetValue(config, section, "h"));
+	}
+
+	al_destroy_config(config);
+	return atlas;
+}
+
+struct AtlasSprite* GetAtlasSprite(struct Atlas* atlas, const char* name) {
+	for (int i = 0; i < atlas->count; i++) {
+		if (strcmp(atlas->sprites[i].name, name) == 0) {
+			return &atlas->sprites[i];
+		}
+	}
+	return NULL;
+}
+
+int UseAtlasSpritesheets(struct Atlas* atlas, struct Character* character) {
+	// Hands the regions of the character's spritesheets packed into the atlas to the
+	// engine as their bitmaps, so that LoadSpritesheets only has to set up the frames
+	// and the sheets get drawn from the atlas page. The engine destroys them together
+	// with the character, so the atlas has to outlive it. Returns how many sheets
+	// were found; the rest still need to be loaded from their files.
+	if (!atlas) {
+		return 0;
+	}
+	int count = 0;
+	for (struct Spritesheet* spritesheet = character->spritesheets; spritesheet; spritesheet = spritesheet->next) {
+		char name[255];
+		snprintf(name, 255, "%s/%s", character->name, spritesheet->name);
+		struct AtlasSprite* sprite = GetAtlasSprite(atlas, name);
+		if (spritesheet->bitmap || !sprite || al_get_bitmap_width(sprite->bitmap) != sprite->width || al_get_bitmap_height(sprite->bitmap) != sprite->height) {
+			continue; // a trimmed sprite wouldn't line up with the frame grid
+		}
+		// the frame size is filled in by whoever loads the bitmap, see RunJob in loader.c
+		spritesheet->width = sprite->width / spritesheet->cols;
+		spritesheet->height = sprite->height / spritesheet->rows;
+		spritesheet->bitmap = al_create_sub_bitmap(sprite->bitmap, 0, 0, sprite->width, sprite->height);
+		count++;
+	}
+	return count;
+}
+
+void DrawAtlasCharacter(struct Game* game, struct Atlas* atlas, struct Character* character, bool twice) {
+	// DrawCharacter (or DrawCharacterTwice) for characters that may be drawn from
+	// an indexed atlas page.
+	struct PalettedBitmap* page = NULL;
+	for (int i = 0; atlas && i < atlas->pagecount; i++) {
+		if (al_get_parent_bitmap(character->spritesheet->bitmap) == atlas->pages[i]->bitmap) {
+			page = atlas->pages[i];
+			break;
+		}
+	}
+	if (page && UsePalette(game, page, twice)) {
+		DrawCharacter(game, character);
+		al_use_shader(NULL);
+	} else if (twice) {
+		DrawCharacterTwice(game, character);
+	} else {
+		DrawCharacter(game, character);
+	}
+}
+
+void DestroyAtlas(struct Atlas* atlas) {
+	for (int i = 0; i < atlas->count; i++) {
+		al_destroy_bitmap(atlas->sprites[i].bitmap);
+		free(atlas->sprites[i].name);
+	}
+	for (int i = 0; i < atlas->pagecount; i++) {
+		DestroyPalettedBitmap(atlas->pages[i]);
+	}
+	free(atlas->sprites);
+	free(atlas->pages);
+	free(atlas);
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include "common.h"
+#include "palette.h"
+
+struct AtlasSprite {
+	char* name;
+	ALLEGRO_BITMAP* bitmap; // sub-bitmap of one of the atlas pages, with transparent borders trimmed unless it's a spritesheet
+	int page;
+	int offsetx, offsety; // position of the trimmed image within the original one
+	int width, height; // size of the original image
+};
+
+struct Atlas {
+	struct PalettedBitmap** pages; // indexed when all the page's sprites share at most 256 colours
+	int pagecount;
+	struct AtlasSprite* sprites;
+	int count;
+};
+
+struct Atlas* LoadAtlas(struct Game* game, const char* manifest);
+struct AtlasSprite* GetAtlasSprite(struct Atlas* atlas, const char* name);
+int UseAtlasSpritesheets(struct Atlas* atlas, struct Character* character);
+void DrawAtlasCharacter(struct Game* game, struct Atlas* atlas, struct Character* character, bool twice);
+void DestroyAtlas(struct Atlas* atlas);
@@ -0,0 +1,258 @@
+/*! \file cache.c
+ *  \brief Reference-counted assets shared between gamestates.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "cache.h"
+#include "common.h"
+#include "preload.h"
+#include <libsuperderpy.h>
+
+// Several gamestates are loaded at the same time and use the same assets,
+// so instead of decoding and uploading them separately, they're kept here
+// keyed by their data path until the last user releases them.
+//
+// Gamestates are loaded on a separate thread, but unloaded on the main one.
+// An asset gets added as pending before it's loaded (outside of the lock),
+// so anyone asking for it in the meantime waits for that load instead of
+// starting another one.
+
+enum CachedAssetType {
+	CACHED_BITMAP,
+	CACHED_SAMPLE,
+	CACHED_FONT,
+	CACHED_CHARACTER,
+};
+
+struct CachedAsset {
+	enum CachedAssetType type;
+	char* key;
+	void* asset; // NULL while pending or when loading failed
+	bool pending;
+	int refs;
+	struct CachedAsset* next;
+};
+
+static void DestroyAsset(struct Game* game, struct CachedAsset* cached);
+
+static struct CachedAsset* FindAsset(struct Game* game, enum CachedAssetType type, const char* key) {
+	for (struct CachedAsset* cached = game->data->cache; cached; cached = cached->next) {
+		if (cached->type == type && strcmp(cached->key, key) == 0) {
+			return cached;
+		}
+	}
+	return NULL;
+}
+
+static struct CachedAsset* AddPendingAsset(struct Game* game, enum CachedAssetType type, const char* key) {
+	struct CachedAsset* cached = calloc(1, sizeof(struct CachedAsset));
+	cached->type = type;
+	cached->key = strdup(key);
+	cached->pending = true;
+	cached->refs = 1;
+	cached->next = game->data->cache;
+	game->data->cache = cached;
+	return cached;
+}
+
+static void Unreference(struct Game* game, struct CachedAsset* cached) {
+	// Called with the lock held.
+	cached->refs--;
+	if (cached->refs) {
+		return;
+	}
+	for (struct CachedAsset** prev = &game->data->cache; *prev; prev = &(*prev)->next) {
+		if (*prev == cached) {
+			*prev = cached->next;
+			break;
+		}
+	}
+	DestroyAsset(game, cached);
+}
+
+static void* WaitForAsset(struct Game* game, struct CachedAsset* cached) {
+	// Called with the lock held and a reference taken. The reference is dropped
+	// again when loading the asset failed.
+	while (cached->pending) {
+		al_wait_cond(game->data->cache_cond, game->data->cache_mutex);
+	}
+	void* asset = cached->asset;
+	if (!asset) {
+		Unreference(game, cached);
+	}
+	return asset;
+}
+
+static void FinishAsset(struct Game* game, struct CachedAsset* cached, void* asset) {
+	al_lock_mutex(game->data->cache_mutex);
+	cached->asset = asset;
+	cached->pending = false;
+	al_broadcast_cond(game->data->cache_cond);
+	if (!asset) {
+		Unreference(game, cached);
+	}
+	al_unlock_mutex(game->data->cache_mutex);
+}
+
+static void* Acquire(struct Game* game, enum CachedAssetType type, const char* key) {
+	al_lock_mutex(game->data->cache_mutex);
+	struct CachedAsset* cached = FindAsset(game, type, key);
+	if (cached) {
+		cached->refs++;
+		void* asset = WaitForAsset(game, cached);
+		al_unlock_mutex(game->data->cache_mutex);
+		return asset;
+	}
+	cached = AddPendingAsset(game, type, key);
+	al_unlock_mutex(game->data->cache_mutex);
+
+	void* asset = NULL;
+	switch (type) {
+		case CACHED_BITMAP:
+			asset = LoadPreloadedBitmap(game, key);
+			break;
+		case CACHED_SAMPLE:
+			asset = LoadPreloadedSample(game, key);
+			break;
+		case CACHED_FONT:
+			asset = al_create_builtin_font();
+			break;
+		case CACHED_CHARACTER:
+			break;
+	}
+	FinishAsset(game, cached, asset);
+	return asset;
+}
+
+ALLEGRO_BITMAP* AcquireBitmap(struct Game* game, const char* filename) {
+	return Acquire(game, CACHED_BITMAP, filename);
+}
+
+ALLEGRO_SAMPLE* AcquireSample(struct Game* game, const char* filename) {
+	return Acquire(game, CACHED_SAMPLE, filename);
+}
+
+ALLEGRO_FONT* AcquireBuiltinFont(struct Game* game) {
+	return Acquire(game, CACHED_FONT, "builtin");
+}
+
+struct Character* AcquireCharacter(struct Game* game, char* name, char* spritesheets[], void (*progress)(struct Game*)) {
+	// Returns a new character that shares its spritesheets with every other
+	// character of the same name. Reports one progress step per spritesheet
+	// either way, so the loading steps stay the same.
+	char key[255];
+	snprintf(key, 255, "%s", name);
+	for (int i = 0; spritesheets[i]; i++) {
+		strncat(key, ":", 254 - strlen(key));
+		strncat(key, spritesheets[i], 254 - strlen(key));
+	}
+
+	al_lock_mutex(game->data->cache_mutex);
+	struct CachedAsset* cached = FindAsset(game, CACHED_CHARACTER, key);
+	struct Character* parent = NULL;
+	if (cached) {
+		cached->refs++;
+		parent = WaitForAsset(game, cached);
+	}
+	if (!parent) {
+		cached = AddPendingAsset(game, CACHED_CHARACTER, key);
+	}
+	al_unlock_mutex(game->data->cache_mutex);
+
+	if (parent) {
+		for (int i = 0; spritesheets[i]; i++) {
+			if (progress) {
+				progress(game);
+			}
+		}
+	} else {
+		parent = CreateCharacter(game, name);
+		for (int i = 0; spritesheets[i]; i++) {
+			RegisterSpritesheet(game, parent, spritesheets[i]);
+		}
+		LoadSpritesheets(game, parent, progress);
+		FinishAsset(game, cached, parent);
+	}
+
+	struct Character* character = CreateCharacter(game, name);
+	character->spritesheets = parent->spritesheets;
+	character->shared = true;
+	return character;
+}
+
+static void DestroyAsset(struct Game* game, struct CachedAsset* cached) {
+	if (cached->asset) { // nothing to destroy when loading failed
+		switch (cached->type) {
+			case CACHED_BITMAP:
+				al_destroy_bitmap(cached->asset);
+				break;
+			case CACHED_SAMPLE:
+				al_destroy_sample(cached->asset);
+				break;
+			case CACHED_FONT:
+				al_destroy_font(cached->asset);
+				break;
+			case CACHED_CHARACTER:
+				DestroyCharacter(game, cached->asset);
+				break;
+		}
+	}
+	free(cached->key);
+	free(cached);
+}
+
+void ReleaseAsset(struct Game* game, void* asset) {
+	al_lock_mutex(game->data->cache_mutex);
+	for (struct CachedAsset* cached = game->data->cache; cached; cached = cached->next) {
+		if (cached->asset == asset) {
+			Unreference(game, cached);
+			break;
+		}
+	}
+	al_unlock_mutex(game->data->cache_mutex);
+}
+
+void ReleaseCharacter(struct Game* game, struct Character* character) {
+	// Find the owner of the spritesheets before letting go of this character.
+	struct Character* parent = NULL;
+	al_lock_mutex(game->data->cache_mutex);
+	for (struct CachedAsset* cached = game->data->cache; cached; cached = cached->next) {
+		if (cached->type == CACHED_CHARACTER && cached->asset && ((struct Character*)cached->asset)->spritesheets == character->spritesheets) {
+			parent = cached->asset;
+			break;
+		}
+	}
+	al_unlock_mutex(game->data->cache_mutex);
+
+	character->spritesheets = NULL;
+	character->spritesheet = NULL;
+	DestroyCharacter(game, character);
+	if (parent) {
+		ReleaseAsset(game, parent);
+	}
+}
+
+void DestroyAssetCache(struct Game* game) {
+	while (game->data->cache) {
+		struct CachedAsset* cached = game->data->cache;
+		PrintConsole(game, "Asset %s still in use on exit (%d references)", cached->key, cached->refs);
+		game->data->cache = cached->next;
+		DestroyAsset(game, cached);
+	}
+}
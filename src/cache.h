@@ -0,0 +1,10 @@
+#pragma once
+#include "common.h"
+
+ALLEGRO_BITMAP* AcquireBitmap(struct Game* game, const char* filename);
+ALLEGRO_SAMPLE* AcquireSample(struct Game* game, const char* filename);
+ALLEGRO_FONT* AcquireBuiltinFont(struct Game* game);
+struct Character* AcquireCharacter(struct Game* game, char* name, char* spritesheets[], void (*progress)(struct Game*));
+void ReleaseAsset(struct Game* game, void* asset);
+void ReleaseCharacter(struct Game* game, struct Character* character);
+void DestroyAssetCache(struct Game* game);
@@ -20,15 +20,66 @@
  */
 
 #include "common.h"
+#include "cache.h"
+#include "diskcache.h"
+#include "idle.h"
+#include "pack.h"
+#include "postfx.h"
+#include "preload.h"
+#include "profiler.h"
+#include "replay.h"
+#include "restore.h"
+#include "trace.h"
 #include <libsuperderpy.h>
 #include <signal.h>
 #include <stdio.h>
 
+static ALLEGRO_SHADER* LoadShader(struct Game* game, const char* name) {
+	// Returns NULL when the display can't run GLSL shaders or this one doesn't
+	// build, so that the code using it falls back to drawing without it.
+	int flags = al_get_display_flags(game->display);
+	if (!(flags & ALLEGRO_OPENGL) || !(flags & ALLEGRO_PROGRAMMABLE_PIPELINE)) {
+		return NULL;
+	}
+	ALLEGRO_SHADER* shader = al_create_shader(ALLEGRO_SHADER_GLSL);
+	if (!shader) {
+		return NULL;
+	}
+	char path[255];
+	snprintf(path, 255, "shaders/%s.glsl", name);
+	if (!al_attach_shader_source_file(shader, ALLEGRO_VERTEX_SHADER, GetDataFilePath(game, "shaders/vertex.glsl")) ||
+		!al_attach_shader_source_file(shader, ALLEGRO_PIXEL_SHADER, GetDataFilePath(game, path)) ||
+		!al_build_shader(shader)) {
+		PrintConsole(game, "Could not build the %s shader, drawing without it: %s", name, al_get_shader_log(shader));
+		al_destroy_shader(shader);
+		return NULL;
+	}
+	return shader;
+}
+
 struct CommonResources* CreateGameData(struct Game* game) {
-	return calloc(1, sizeof(struct CommonResources));
+	struct CommonResources* resources = calloc(1, sizeof(struct CommonResources));
+	resources->cache_mutex = al_create_mutex();
+	resources->cache_cond = al_create_cond();
+	OpenPack(game);
+	InitDiskCache(game);
+	InitRestore(game);
+	resources->palette = LoadShader(game, "palette");
+	resources->crossfade = LoadShader(game, "crossfade");
+	resources->twice = LoadShader(game, "twice");
+	resources->checkerboard = LoadShader(game, "checkerboard");
+	return resources;
 }
 
 bool GlobalEventHandler(struct Game* game, ALLEGRO_EVENT* event) {
+	IdleEvent(game, event);
+	if (ProfilerEvent(game, event)) {
+		return true;
+	}
+	if (HandleReplayEvent(game, event)) {
+		return true;
+	}
+	RestoreEvent(game, event);
 	if (event->type == ALLEGRO_EVENT_TOUCH_BEGIN) {
 		game->data->touch = true;
 	}
@@ -40,21 +91,94 @@ bool GlobalEventHandler(struct Game* game, ALLEGRO_EVENT* event) {
 	return false;
 }
 
+void GlobalPreLogic(struct Game* game, double delta) {
+	IdlePreLogic(game);
+	ProfilerPreLogic(game);
+}
+
+void GlobalPostLogic(struct Game* game, double delta) {
+	ReplayLogic(game, delta);
+	ProfilerPostLogic(game);
+}
+
+void GlobalPreDraw(struct Game* game) {
+	ProfilerPreDraw(game);
+	RestorePreDraw(game);
+	IdlePreDraw(game);
+}
+
+void GlobalPostDraw(struct Game* game) {
+	ProfilerPostDraw(game);
+	IdlePostDraw(game);
+}
+
 void DestroyGameData(struct Game* game) {
 	struct CommonResources* resources = game->data;
 	if (resources->music) al_destroy_audio_stream(resources->music);
 	if (resources->button) al_destroy_sample_instance(resources->button);
 	if (resources->button_sample) al_destroy_sample(resources->button_sample);
+	if (resources->palette) al_destroy_shader(resources->palette);
+	if (resources->crossfade) al_destroy_shader(resources->crossfade);
+	if (resources->twice) al_destroy_shader(resources->twice);
+	if (resources->checkerboard) al_destroy_shader(resources->checkerboard);
+	DestroyPreload(game);
+	DestroyAssetCache(game);
+	al_destroy_mutex(resources->cache_mutex);
+	al_destroy_cond(resources->cache_cond);
+	ClosePack();
+	StopReplay();
+	DestroyProfiler();
+	StopTrace();
+	DestroyIdle();
+	DestroyRenderTargets();
+	DestroyRestore();
+	DestroyDiskCache();
 	free(resources);
 }
 
+static const char* GAMESTATES[] = {"intro", "fall", "catch", "fine", "notfine", "logo", "walk"};
+
 void StartGame(struct Game* game, bool restart) {
-	LoadGamestate(game, "intro");
-	LoadGamestate(game, "fall");
-	LoadGamestate(game, "catch");
-	LoadGamestate(game, "fine");
-	LoadGamestate(game, "notfine");
-	LoadGamestate(game, "logo");
-	LoadGamestate(game, "walk");
+	for (int i = 0; i < sizeof(GAMESTATES) / sizeof(GAMESTATES[0]); i++) {
+		LoadGamestate(game, GAMESTATES[i]);
+	}
 	StartGamestate(game, restart ? "walk" : "intro");
 }
+
+void RestartGame(struct Game* game, bool restart) {
+	// The game's gamestates only get stopped when switching between them, so
+	// they're all still loaded and replaying only needs to stop whatever runs
+	// right now. Gamestate_Start of each of them resets its state.
+	for (int i = 0; i < sizeof(GAMESTATES) / sizeof(GAMESTATES[0]); i++) {
+		struct Gamestate* gamestate = GetGamestate(game, GAMESTATES[i]);
+		if (!gamestate || !gamestate->loaded) {
+			PrintConsole(game, "Gamestate %s not loaded, restarting from scratch.", GAMESTATES[i]);
+			UnloadAllGamestates(game);
+			StartGame(game, restart);
+			return;
+		}
+	}
+	for (int i = 0; i < sizeof(GAMESTATES) / sizeof(GAMESTATES[0]); i++) {
+		if (GetGamestate(game, GAMESTATES[i])->started) {
+			StopGamestate(game, GAMESTATES[i]);
+		}
+	}
+	StartGamestate(game, restart ? "walk" : "intro");
+}
+
+void EnableHeadless(struct Game* game) {
+	// Meant for benchmarking and soak-testing the game logic, e.g. together with
+	// --replay. Nothing gets drawn or heard, and every frame advances the game by
+	// exactly one tick instead of following the clock, so without vsync the
+	// simulation runs as fast as the engine can loop. The engine still needs a
+	// display to start, which on machines without a GPU can be provided by Xvfb
+	// with software rendering.
+	game->data->headless = true;
+	al_set_mixer_gain(game->audio.mixer, 0);
+	PrintConsole(game, "Running headless.");
+}
+
+double SimulationDelta(struct Game* game, double delta) {
+	// Time to advance the simulation by in Gamestate_Logic.
+	return game->data->headless ? 1 / 60.0 : delta;
+}
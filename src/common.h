@@ -1,3 +1,4 @@
+#pragma once
 #define LIBSUPERDERPY_DATA_TYPE struct CommonResources
 #include <libsuperderpy.h>
 
@@ -5,12 +6,27 @@ struct CommonResources {
 	ALLEGRO_AUDIO_STREAM* music;
 	ALLEGRO_SAMPLE* button_sample;
 	ALLEGRO_SAMPLE_INSTANCE* button;
+	ALLEGRO_SHADER* palette; // NULL when indexed bitmaps can't be drawn, see palette.c
+	ALLEGRO_SHADER *crossfade, *twice; // NULL when blending falls back to multiple draws, see layers.c
+	ALLEGRO_SHADER* checkerboard; // NULL when overlays are drawn from bitmaps, see postfx.c
+	struct CachedAsset* cache; // see cache.c
+	ALLEGRO_MUTEX* cache_mutex;
+	ALLEGRO_COND* cache_cond; // signalled when a pending asset gets loaded
+	struct Preload* preload; // see preload.c
 	int score;
 	bool logo;
 	bool touch;
+	bool headless; // see EnableHeadless
 };
 
 struct CommonResources* CreateGameData(struct Game* game);
 void DestroyGameData(struct Game* game);
 bool GlobalEventHandler(struct Game* game, ALLEGRO_EVENT* event);
+void GlobalPreLogic(struct Game* game, double delta);
+void GlobalPostLogic(struct Game* game, double delta);
+void GlobalPreDraw(struct Game* game);
+void GlobalPostDraw(struct Game* game);
 void StartGame(struct Game* game, bool restart);
+void RestartGame(struct Game* game, bool restart);
+void EnableHeadless(struct Game* game);
+double SimulationDelta(struct Game* game, double delta);
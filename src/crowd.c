@@ -0,0 +1,339 @@
+/*! \file crowd.c
+ *  \brief Audience seated in rows, drawn out of a single texture atlas.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "common.h"
+#include "crowd.h"
+#include "restore.h"
+#include <libsuperderpy.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+
+#define ATLAS_WIDTH 512
+#define SEAT_SPACING 40
+#define SEATS_PER_BITMAP 8
+
+static void Restore(struct Game* game, void* crowd) {
+	// The layer isn't preserved, but can always be redrawn.
+	InvalidateCrowd(game, crowd);
+}
+
+struct Crowd* CreateCrowd(struct Game* game, struct Character* character, int rows, int cols, int width, int height) {
+	struct Crowd* crowd = calloc(1, sizeof(struct Crowd));
+	crowd->name = strdup(character->name);
+	crowd->rows = rows;
+	crowd->cols = cols;
+	crowd->count = rows * cols;
+
+	crowd->x = calloc(crowd->count, sizeof(float));
+	crowd->y = calloc(crowd->count, sizeof(float));
+	crowd->sprite = calloc(crowd->count, sizeof(int));
+	crowd->jitter = calloc(crowd->count, sizeof(int));
+	crowd->rowx = calloc(rows, sizeof(float));
+	crowd->rowy = calloc(rows, sizeof(float));
+
+	float spacing = 10, x = 117, y = 88;
+	for (int i = 0; i < rows; i++) {
+		crowd->rowx[i] = x;
+		crowd->rowy[i] = y;
+		x -= spacing;
+		y += spacing;
+		spacing += 0.5;
+	}
+
+	for (int i = 0; i < crowd->count; i++) {
+		crowd->jitter[i] = rand() % 5;
+		crowd->sprite[i] = -1;
+	}
+
+	for (struct Spritesheet* spritesheet = character->spritesheets; spritesheet; spritesheet = spritesheet->next) {
+		crowd->spritecount++;
+	}
+	crowd->sprites = calloc(crowd->spritecount, sizeof(struct CrowdSprite));
+	int i = 0;
+	for (struct Spritesheet* spritesheet = character->spritesheets; spritesheet; spritesheet = spritesheet->next) {
+		crowd->sprites[i++].spritesheet = spritesheet;
+	}
+
+	crowd->layer = CreateNotPreservedBitmap(width, height);
+	InvalidateCrowd(game, crowd);
+	TrackResource(crowd, Restore);
+
+	return crowd;
+}
+
+void DestroyCrowd(struct Game* game, struct Crowd* crowd) {
+	UntrackResource(crowd);
+	if (!crowd->prebuilt) {
+		for (int i = 0; i < crowd->spritecount; i++) {
+			if (crowd->sprites[i].bitmap) {
+				al_destroy_bitmap(crowd->sprites[i].bitmap);
+			}
+		}
+		if (crowd->seats) {
+			al_destroy_bitmap(crowd->seats);
+		}
+		if (crowd->atlas) {
+			al_destroy_bitmap(crowd->atlas);
+		}
+	}
+	al_destroy_bitmap(crowd->layer);
+	free(crowd->sprites);
+	free(crowd->name);
+	free(crowd->x);
+	free(crowd->y);
+	free(crowd->sprite);
+	free(crowd->jitter);
+	free(crowd->rowx);
+	free(crowd->rowy);
+	free(crowd);
+}
+
+static bool UsePrebuiltAtlas(struct Game* game, struct Crowd* crowd, struct Atlas* atlas) {
+	// All the sprites need to end up on the same atlas page, otherwise drawing
+	// the crowd couldn't be batched anyway.
+	if (!atlas) {
+		return false;
+	}
+
+	// The crowd layer gets drawn without the palette shader.
+	struct AtlasSprite* seats = GetAtlasSprite(atlas, "sits");
+	bool usable = seats && !atlas->pages[seats->page]->palette;
+	for (int i = 0; usable && i < crowd->spritecount; i++) {
+		char name[255];
+		snprintf(name, 255, "%s/%s", crowd->name, crowd->sprites[i].spritesheet->name);
+		struct AtlasSprite* sprite = GetAtlasSprite(atlas, name);
+		if (!sprite || sprite->page != seats->page) {
+			usable = false;
+			break;
+		}
+		crowd->sprites[i].bitmap = sprite->bitmap;
+		crowd->sprites[i].offsetx = sprite->offsetx;
+		crowd->sprites[i].offsety = sprite->offsety;
+	}
+
+	if (!usable) {
+		PrintConsole(game, "Prebuilt atlas doesn't cover the %s crowd, packing it at runtime.", crowd->name);
+		for (int i = 0; i < crowd->spritecount; i++) {
+			crowd->sprites[i].bitmap = NULL;
+			crowd->sprites[i].offsetx = 0;
+			crowd->sprites[i].offsety = 0;
+		}
+		return false;
+	}
+
+	crowd->prebuilt = atlas;
+	crowd->atlas = atlas->pages[seats->page]->bitmap;
+	crowd->seats = seats->bitmap;
+	crowd->seatsoffsetx = seats->offsetx;
+	crowd->seatsoffsety = seats->offsety;
+	return true;
+}
+
+void BuildCrowdAtlas(struct Game* game, struct Crowd* crowd, struct PalettedBitmap* seats, struct Atlas* atlas) {
+	// The prebuilt atlas (if any) stays owned by the caller and has to outlive the crowd.
+	if (UsePrebuiltAtlas(game, crowd, atlas)) {
+		InvalidateCrowd(game, crowd);
+		return;
+	}
+
+	// Pack all the spritesheets and the seats into one texture (simple shelf packing,
+	// with 1px of padding to keep the sprites from bleeding into each other).
+	// Needs to be called from the main thread, i.e. in Gamestate_PostLoad.
+	int count = crowd->spritecount + 1;
+	ALLEGRO_BITMAP** bitmaps = calloc(count, sizeof(ALLEGRO_BITMAP*));
+	int* positions = calloc(count * 2, sizeof(int));
+
+	for (int i = 0; i < crowd->spritecount; i++) {
+		bitmaps[i] = crowd->sprites[i].spritesheet->bitmap;
+	}
+	bitmaps[count - 1] = seats ? seats->bitmap : NULL;
+
+	int x = 0, y = 0, height = 0;
+	for (int i = 0; i < count; i++) {
+		if (!bitmaps[i]) {
+			continue; // spritesheet that wasn't loaded
+		}
+		int w = al_get_bitmap_width(bitmaps[i]) + 1, h = al_get_bitmap_height(bitmaps[i]) + 1;
+		if (x + w > ATLAS_WIDTH) {
+			x = 0;
+			y += height;
+			height = 0;
+		}
+		positions[i * 2] = x;
+		positions[i * 2 + 1] = y;
+		x += w;
+		if (h > height) {
+			height = h;
+		}
+	}
+
+	crowd->atlas = al_create_bitmap(ATLAS_WIDTH, y + height);
+	al_set_target_bitmap(crowd->atlas);
+	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+	for (int i = 0; i < count; i++) {
+		if (i == count - 1 && seats) {
+			DrawPalettedBitmap(game, seats, al_map_rgb(255, 255, 255), 0, 0, seats->width, seats->height,
+				positions[i * 2], positions[i * 2 + 1], seats->width, seats->height, 0);
+		} else if (bitmaps[i]) {
+			al_draw_bitmap(bitmaps[i], positions[i * 2], positions[i * 2 + 1], 0);
+		}
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (!bitmaps[i]) {
+			continue;
+		}
+		ALLEGRO_BITMAP* bitmap = al_create_sub_bitmap(crowd->atlas, positions[i * 2], positions[i * 2 + 1],
+			al_get_bitmap_width(bitmaps[i]), al_get_bitmap_height(bitmaps[i]));
+		if (i < crowd->spritecount) {
+			crowd->sprites[i].bitmap = bitmap;
+		} else {
+			crowd->seats = bitmap;
+		}
+	}
+
+	free(bitmaps);
+	free(positions);
+	al_set_target_backbuffer(game->display);
+	InvalidateCrowd(game, crowd);
+}
+
+int GetCrowdSprite(struct Crowd* crowd, const char* name) {
+	for (int i = 0; i < crowd->spritecount; i++) {
+		if (strcmp(crowd->sprites[i].spritesheet->name, name) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void MarkDirty(struct Crowd* crowd, int i) {
+	if (crowd->sprite[i] < 0) {
+		return;
+	}
+	struct Spritesheet* spritesheet = crowd->sprites[crowd->sprite[i]].spritesheet;
+	int x = (int)crowd->x[i], y = (int)crowd->y[i];
+	crowd->dirty[0] = fmin(crowd->dirty[0], x);
+	crowd->dirty[1] = fmin(crowd->dirty[1], y);
+	crowd->dirty[2] = fmax(crowd->dirty[2], x + spritesheet->width);
+	crowd->dirty[3] = fmax(crowd->dirty[3], y + spritesheet->height);
+}
+
+void ResetCrowd(struct Game* game, struct Crowd* crowd) {
+	for (int row = 0; row < crowd->rows; row++) {
+		for (int col = 0; col < crowd->cols; col++) {
+			int i = row * crowd->cols + col;
+			crowd->x[i] = crowd->rowx[row] + SEAT_SPACING * col + 9 - crowd->jitter[i] + 2;
+			crowd->y[i] = crowd->rowy[row] - 18;
+		}
+	}
+	InvalidateCrowd(game, crowd);
+}
+
+void SetCrowdMemberSprite(struct Game* game, struct Crowd* crowd, int i, int sprite) {
+	MarkDirty(crowd, i);
+	crowd->sprite[i] = sprite;
+	MarkDirty(crowd, i);
+}
+
+void MoveCrowdMember(struct Game* game, struct Crowd* crowd, int i, float dx, float dy) {
+	MarkDirty(crowd, i);
+	crowd->x[i] += dx;
+	crowd->y[i] += dy;
+	MarkDirty(crowd, i);
+}
+
+void InvalidateCrowd(struct Game* game, struct Crowd* crowd) {
+	crowd->dirty[0] = 0;
+	crowd->dirty[1] = 0;
+	crowd->dirty[2] = al_get_bitmap_width(crowd->layer);
+	crowd->dirty[3] = al_get_bitmap_height(crowd->layer);
+}
+
+void UpdateCrowdLayer(struct Game* game, struct Crowd* crowd) {
+	// The crowd is baked into its own layer. Only the dirty part of it gets cleared
+	// and redrawn, together with all the rows that overlap it to keep the order right.
+	int x1 = crowd->dirty[0], y1 = crowd->dirty[1], x2 = crowd->dirty[2], y2 = crowd->dirty[3];
+	if (x1 >= x2 || y1 >= y2 || !crowd->seats) {
+		return;
+	}
+
+	al_set_target_bitmap(crowd->layer);
+	al_set_clipping_rectangle(x1, y1, x2 - x1, y2 - y1);
+	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+
+	// Everything comes from a single texture, so the whole crowd
+	// gets submitted in one batch while keeping the row order intact.
+	al_hold_bitmap_drawing(true);
+
+	int seatheight = crowd->seatsoffsety + al_get_bitmap_height(crowd->seats);
+	for (int row = 0; row < crowd->rows; row++) {
+		int top = (int)crowd->rowy[row], bottom = top + seatheight;
+		for (int i = row * crowd->cols; i < (row + 1) * crowd->cols; i++) {
+			if (crowd->sprite[i] >= 0) {
+				top = fmin(top, (int)crowd->y[i]);
+				bottom = fmax(bottom, (int)crowd->y[i] + crowd->sprites[crowd->sprite[i]].spritesheet->height);
+			}
+		}
+		if (bottom <= y1 || top >= y2) {
+			continue;
+		}
+
+		for (int i = row * crowd->cols; i < (row + 1) * crowd->cols; i++) {
+			if (crowd->sprite[i] >= 0 && crowd->sprites[crowd->sprite[i]].bitmap) {
+				struct CrowdSprite* sprite = &crowd->sprites[crowd->sprite[i]];
+				al_draw_bitmap_region(sprite->bitmap, 0, 0,
+					fmin(sprite->spritesheet->width, al_get_bitmap_width(sprite->bitmap)), fmin(sprite->spritesheet->height, al_get_bitmap_height(sprite->bitmap)),
+					(int)crowd->x[i] + sprite->offsetx, (int)crowd->y[i] + sprite->offsety, 0);
+			}
+		}
+		for (int col = 0; col < crowd->cols; col += SEATS_PER_BITMAP) {
+			al_draw_bitmap(crowd->seats, (int)crowd->rowx[row] + col * SEAT_SPACING + crowd->seatsoffsetx, (int)crowd->rowy[row] + crowd->seatsoffsety, 0);
+		}
+	}
+
+	al_hold_bitmap_drawing(false);
+	al_reset_clipping_rectangle();
+
+	crowd->dirty[0] = INT_MAX;
+	crowd->dirty[1] = INT_MAX;
+	crowd->dirty[2] = INT_MIN;
+	crowd->dirty[3] = INT_MIN;
+}
+
+void DrawCrowdCharacter(struct Game* game, struct Crowd* crowd, struct Character* character) {
+	// Draws the current frame of a character that uses one of the crowd spritesheets
+	// straight out of the atlas.
+	struct Spritesheet* spritesheet = character->spritesheet;
+	for (int i = 0; i < crowd->spritecount; i++) {
+		struct CrowdSprite* sprite = &crowd->sprites[i];
+		if (sprite->spritesheet == spritesheet && sprite->bitmap) {
+			// trimmed sprites are always single-frame, so the frame grid stays intact
+			int sx = (character->pos % spritesheet->cols) * spritesheet->width, sy = (character->pos / spritesheet->cols) * spritesheet->height;
+			al_draw_bitmap_region(sprite->bitmap, sx, sy,
+				fmin(spritesheet->width, al_get_bitmap_width(sprite->bitmap) - sx), fmin(spritesheet->height, al_get_bitmap_height(sprite->bitmap) - sy),
+				(int)GetCharacterX(game, character) + sprite->offsetx, (int)GetCharacterY(game, character) + sprite->offsety, 0);
+			return;
+		}
+	}
+	DrawCharacter(game, character);
+}
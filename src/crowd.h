@@ -0,0 +1,41 @@
+#pragma once
+#include "atlas.h"
+#include "common.h"
+
+struct CrowdSprite {
+	struct Spritesheet* spritesheet;
+	ALLEGRO_BITMAP* bitmap; // sub-bitmap of the crowd atlas
+	int offsetx, offsety; // trimmed borders of a prebuilt atlas sprite
+};
+
+struct Crowd {
+	char* name;
+	int rows, cols, count;
+
+	// per seat, indexed by row * cols + col
+	float *x, *y;
+	int* sprite; // index into sprites, -1 for an empty seat
+	int* jitter;
+
+	// per row, computed once on creation
+	float *rowx, *rowy;
+
+	struct CrowdSprite* sprites;
+	int spritecount;
+
+	struct Atlas* prebuilt; // set when the sprites come from the build-time atlas (not owned)
+	ALLEGRO_BITMAP *atlas, *seats, *layer;
+	int seatsoffsetx, seatsoffsety;
+	int dirty[4]; // x1, y1, x2, y2 of the part of the layer that needs to be redrawn
+};
+
+struct Crowd* CreateCrowd(struct Game* game, struct Character* character, int rows, int cols, int width, int height);
+void DestroyCrowd(struct Game* game, struct Crowd* crowd);
+void BuildCrowdAtlas(struct Game* game, struct Crowd* crowd, struct PalettedBitmap* seats, struct Atlas* atlas);
+int GetCrowdSprite(struct Crowd* crowd, const char* name);
+void ResetCrowd(struct Game* game, struct Crowd* crowd);
+void SetCrowdMemberSprite(struct Game* game, struct Crowd* crowd, int i, int sprite);
+void MoveCrowdMember(struct Game* game, struct Crowd* crowd, int i, float dx, float dy);
+void InvalidateCrowd(struct Game* game, struct Crowd* crowd);
+void UpdateCrowdLayer(struct Game* game, struct Crowd* crowd);
+void DrawCrowdCharacter(struct Game* game, struct Crowd* crowd, struct Character* character);
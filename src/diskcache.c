@@ -0,0 +1,248 @@
+/*! \file diskcache.c
+ *  \brief Decoded images and sounds cached on disk between runs.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "diskcache.h"
+#include "common.h"
+#include "mapping.h"
+#include "pack.h"
+#include <libsuperderpy.h>
+#include <stdio.h>
+#ifdef _WIN32
+#include <process.h>
+#include <windows.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+// Decoding PNG and FLAC files takes much longer than reading raw pixels and
+// samples, so once decoded, they're written into the user's data directory
+// and mapped straight from there on the next runs. Each cache file is named
+// after the path of its source file and stores a hash of the source file's
+// contents, so it gets rebuilt whenever the asset changes.
+//
+// Called from the loader's worker threads, so nothing here touches the engine.
+
+#define CACHE_MAGIC "CDC1"
+#define CACHE_HEADER 32
+
+enum {
+	CACHE_BITMAP,
+	CACHE_SAMPLE,
+};
+
+static char* directory = NULL;
+static ALLEGRO_MUTEX* mutex = NULL; // guards the counter of temporary files
+static unsigned int written = 0;
+
+void InitDiskCache(struct Game* game) {
+#ifndef __EMSCRIPTEN__
+	ALLEGRO_PATH* path = al_get_standard_path(ALLEGRO_USER_DATA_PATH);
+	al_append_path_component(path, "cache");
+	if (al_make_directory(al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP))) {
+		directory = strdup(al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP));
+		mutex = al_create_mutex();
+	} else {
+		PrintConsole(game, "Could not create asset cache directory, decoding everything from scratch.");
+	}
+	al_destroy_path(path);
+#endif
+}
+
+void DestroyDiskCache(void) {
+	free(directory);
+	directory = NULL;
+	if (mutex) {
+		al_destroy_mutex(mutex);
+	}
+	mutex = NULL;
+}
+
+static uint64_t Hash(const unsigned char* data, size_t size, uint64_t hash) {
+	// FNV-1a
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ data[i]) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+static bool HashFile(const char* path, uint64_t* hash) {
+	ALLEGRO_FILE* file = OpenAsset(path);
+	if (!file) {
+		return false;
+	}
+	unsigned char buffer[65536];
+	size_t size;
+	*hash = 14695981039346656037ULL;
+	while ((size = al_fread(file, buffer, sizeof(buffer)))) {
+		*hash = Hash(buffer, size, *hash);
+	}
+	al_fclose(file);
+	return true;
+}
+
+static char* CachePath(const char* path, int type) {
+	char* result = malloc(strlen(directory) + 32);
+	sprintf(result, "%s%016llx.%s", directory, (unsigned long long)Hash((const unsigned char*)path, strlen(path), 14695981039346656037ULL),
+		type == CACHE_BITMAP ? "pixels" : "pcm");
+	return result;
+}
+
+static const unsigned char* OpenCache(const char* path, int type, uint64_t hash, struct Mapping* mapping, uint32_t header[4]) {
+	// Returns the payload of a valid cache file, NULL when it needs to be rebuilt.
+	char* cache = CachePath(path, type);
+	bool mapped = MapFile(cache, mapping);
+	free(cache);
+	if (!mapped) {
+		return NULL;
+	}
+	if (mapping->size < CACHE_HEADER) {
+		UnmapFile(mapping);
+		return NULL;
+	}
+	uint64_t stored;
+	memcpy(&stored, mapping->data + 8, 8);
+	if (memcmp(mapping->data, CACHE_MAGIC, 4) != 0 || mapping->data[4] != type || stored != hash) {
+		UnmapFile(mapping);
+		return NULL;
+	}
+	memcpy(header, mapping->data + 16, 16);
+	return mapping->data + CACHE_HEADER;
+}
+
+static bool MoveIntoPlace(const char* from, const char* to) {
+	// rename() on Windows refuses to replace an existing file, which would keep
+	// a stale entry from ever being rebuilt.
+#ifdef _WIN32
+	return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING);
+#else
+	return rename(from, to) == 0;
+#endif
+}
+
+static void WriteCache(const char* path, int type, uint64_t hash, const uint32_t header[4], const void* data, size_t size) {
+	char* cache = CachePath(path, type);
+
+	// Written under a temporary name that's unique to this process and call, so that
+	// other threads or runs writing the same entry never see or clobber a partial file.
+	al_lock_mutex(mutex);
+	unsigned int id = written++;
+	al_unlock_mutex(mutex);
+	char* tmp = malloc(strlen(cache) + 32);
+	sprintf(tmp, "%s.%d-%u.tmp", cache, (int)getpid(), id);
+
+	FILE* file = fopen(tmp, "wb");
+	if (file) {
+		unsigned char head[CACHE_HEADER] = {0};
+		memcpy(head, CACHE_MAGIC, 4);
+		head[4] = type;
+		memcpy(head + 8, &hash, 8);
+		memcpy(head + 16, header, 16);
+		bool ok = fwrite(head, 1, CACHE_HEADER, file) == CACHE_HEADER && fwrite(data, 1, size, file) == size;
+		ok = (fclose(file) == 0) && ok;
+		if (!ok || !MoveIntoPlace(tmp, cache)) {
+			remove(tmp);
+		}
+	}
+	free(tmp);
+	free(cache);
+}
+
+ALLEGRO_BITMAP* LoadCachedBitmap(const char* path) {
+	uint64_t hash;
+	if (!directory || !HashFile(path, &hash)) {
+		return LoadAssetBitmap(path);
+	}
+
+	struct Mapping mapping;
+	uint32_t header[4];
+	const unsigned char* pixels = OpenCache(path, CACHE_BITMAP, hash, &mapping, header);
+	if (pixels && mapping.size >= CACHE_HEADER + (size_t)header[0] * header[1] * 4) {
+		ALLEGRO_BITMAP* bitmap = al_create_bitmap(header[0], header[1]);
+		ALLEGRO_LOCKED_REGION* region = bitmap ? al_lock_bitmap(bitmap, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_WRITEONLY) : NULL;
+		if (region) {
+			for (uint32_t y = 0; y < header[1]; y++) {
+				memcpy((unsigned char*)region->data + y * region->pitch, pixels + y * header[0] * 4, header[0] * 4);
+			}
+			al_unlock_bitmap(bitmap);
+			UnmapFile(&mapping);
+			return bitmap;
+		}
+		if (bitmap) {
+			al_destroy_bitmap(bitmap);
+		}
+	}
+	if (pixels) {
+		UnmapFile(&mapping);
+	}
+
+	ALLEGRO_BITMAP* bitmap = LoadAssetBitmap(path);
+	if (!bitmap) {
+		return NULL;
+	}
+	int width = al_get_bitmap_width(bitmap), height = al_get_bitmap_height(bitmap);
+	ALLEGRO_LOCKED_REGION* region = al_lock_bitmap(bitmap, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_READONLY);
+	if (region) {
+		unsigned char* data = malloc(width * height * 4);
+		for (int y = 0; y < height; y++) {
+			memcpy(data + y * width * 4, (unsigned char*)region->data + y * region->pitch, width * 4);
+		}
+		al_unlock_bitmap(bitmap);
+		WriteCache(path, CACHE_BITMAP, hash, (uint32_t[]){width, height, 0, 0}, data, width * height * 4);
+		free(data);
+	}
+	return bitmap;
+}
+
+ALLEGRO_SAMPLE* LoadCachedSample(const char* path) {
+	uint64_t hash;
+	if (!directory || !HashFile(path, &hash)) {
+		return LoadAssetSample(path);
+	}
+
+	struct Mapping mapping;
+	uint32_t header[4]; // length, frequency, depth, channel configuration
+	const unsigned char* pcm = OpenCache(path, CACHE_SAMPLE, hash, &mapping, header);
+	if (pcm) {
+		size_t size = (size_t)header[0] * al_get_channel_count(header[3]) * al_get_audio_depth_size(header[2]);
+		if (mapping.size >= CACHE_HEADER + size) {
+			void* buffer = malloc(size);
+			memcpy(buffer, pcm, size);
+			UnmapFile(&mapping);
+			ALLEGRO_SAMPLE* sample = al_create_sample(buffer, header[0], header[1], header[2], header[3], true);
+			if (sample) {
+				return sample;
+			}
+			free(buffer);
+		} else {
+			UnmapFile(&mapping);
+		}
+	}
+
+	ALLEGRO_SAMPLE* sample = LoadAssetSample(path);
+	if (!sample) {
+		return NULL;
+	}
+	uint32_t info[4] = {al_get_sample_length(sample), al_get_sample_frequency(sample), al_get_sample_depth(sample), al_get_sample_channels(sample)};
+	size_t size = (size_t)info[0] * al_get_channel_count(info[3]) * al_get_audio_depth_size(info[2]);
+	WriteCache(path, CACHE_SAMPLE, hash, info, al_get_sample_data(sample), size);
+	return sample;
+}
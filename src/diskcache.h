@@ -0,0 +1,7 @@
+#pragma once
+#include "common.h"
+
+void InitDiskCache(struct Game* game);
+void DestroyDiskCache(void);
+ALLEGRO_BITMAP* LoadCachedBitmap(const char* path);
+ALLEGRO_SAMPLE* LoadCachedSample(const char* path);
@@ -0,0 +1,234 @@
+/*! \file framestream.c
+ *  \brief Animations decoded frame by frame from a delta-encoded stream.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "framestream.h"
+#include "common.h"
+#include "restore.h"
+#include <libsuperderpy.h>
+
+// Instead of keeping a whole spritesheet in VRAM, only a small ring of textures
+// gets filled with frames decoded just ahead of playback. See tools/framepack.c
+// for the stream format.
+
+static int Get16(const unsigned char* data) {
+	return data[0] | (data[1] << 8);
+}
+
+static int64_t Get32(const unsigned char* data) {
+	return data[0] | (data[1] << 8) | (data[2] << 16) | ((int64_t)data[3] << 24);
+}
+
+static void Restore(struct Game* game, void* stream) {
+	ReloadFrameStream(game, stream);
+}
+
+static bool ReadFrameHeader(struct FrameStream* stream, int64_t* size) {
+	// Reads the size of the frame at the current offset and checks that all of
+	// its data is actually there.
+	unsigned char header[4];
+	if (!al_fseek(stream->file, stream->offset, ALLEGRO_SEEK_SET) || al_fread(stream->file, header, 4) != 4) {
+		return false;
+	}
+	*size = Get32(header);
+	return stream->offset + 4 + *size <= stream->size;
+}
+
+struct FrameStream* LoadFrameStream(struct Game* game, const char* filename) {
+	// Returns NULL when the stream can't be found, so the caller can fall back to the spritesheet.
+	char* path = FindDataFilePath(game, filename);
+	if (!path) {
+		return NULL;
+	}
+	ALLEGRO_FILE* file = al_fopen(path, "rb");
+	free(path);
+	if (!file) {
+		return NULL;
+	}
+
+	// Only the frame being decoded is kept in memory, the rest stays in the file.
+	struct FrameStream* stream = calloc(1, sizeof(struct FrameStream));
+	stream->file = file;
+	stream->size = al_fsize(file);
+	unsigned char header[12];
+	bool valid = stream->size >= 12 && al_fread(file, header, 12) == 12 && memcmp(header, "CSEQ", 4) == 0;
+	if (valid) {
+		stream->width = Get16(header + 4);
+		stream->height = Get16(header + 6);
+		stream->count = Get16(header + 8);
+		stream->duration = Get16(header + 10) / 1000.0;
+		valid = stream->width > 0 && stream->height > 0 && stream->count > 0 && 12 + stream->count * 4 <= stream->size;
+	}
+
+	// Walk through the frame headers once, so that a truncated file gets rejected
+	// up front and the buffer can be allocated for the largest frame.
+	int64_t largest = 0;
+	stream->offset = 12;
+	for (int i = 0; valid && i < stream->count; i++) {
+		int64_t size;
+		valid = ReadFrameHeader(stream, &size);
+		stream->offset += 4 + size;
+		if (size > largest) {
+			largest = size;
+		}
+	}
+
+	if (!valid) {
+		PrintConsole(game, "Invalid frame stream: %s", filename);
+		al_fclose(file);
+		free(stream);
+		return NULL;
+	}
+
+	stream->buffer = malloc(largest);
+	stream->pixels = malloc(stream->width * stream->height * 4);
+
+	for (int i = 0; i < FRAMESTREAM_RING; i++) {
+		stream->ring[i] = CreateNotPreservedBitmap(stream->width, stream->height);
+	}
+	TrackResource(stream, Restore);
+
+	RewindFrameStream(game, stream);
+	return stream;
+}
+
+void DestroyFrameStream(struct Game* game, struct FrameStream* stream) {
+	UntrackResource(stream);
+	for (int i = 0; i < FRAMESTREAM_RING; i++) {
+		al_destroy_bitmap(stream->ring[i]);
+	}
+	al_fclose(stream->file);
+	free(stream->buffer);
+	free(stream->pixels);
+	free(stream);
+}
+
+static void ResetDecoder(struct FrameStream* stream) {
+	memset(stream->pixels, 0, stream->width * stream->height * 4);
+	for (int i = 0; i < stream->width * stream->height; i++) {
+		stream->pixels[i * 4 + 3] = 255;
+	}
+	stream->offset = 12;
+	stream->decoded = -1;
+	stream->uploaded = -1;
+}
+
+static bool DecodeFrame(struct FrameStream* stream) {
+	// Returns false when the frame can't be read or doesn't decode cleanly.
+	int64_t size;
+	if (!ReadFrameHeader(stream, &size) || al_fread(stream->file, stream->buffer, size) != size) {
+		return false;
+	}
+	const unsigned char *in = stream->buffer, *end = in + size;
+	unsigned char* out = stream->pixels;
+	unsigned char* last = stream->pixels + stream->width * stream->height * 4;
+
+	while (in + 4 <= end) {
+		int skip = Get16(in), copy = Get16(in + 2);
+		in += 4;
+		out += skip * 4;
+		if (out + copy * 4 > last || in + copy * 3 > end) {
+			return false;
+		}
+		for (int i = 0; i < copy; i++) {
+			out[0] = in[0];
+			out[1] = in[1];
+			out[2] = in[2];
+			out += 4;
+			in += 3;
+		}
+	}
+
+	stream->offset += 4 + size;
+	stream->decoded++;
+	return true;
+}
+
+static void UploadFrame(struct FrameStream* stream) {
+	ALLEGRO_BITMAP* bitmap = stream->ring[stream->decoded % FRAMESTREAM_RING];
+	ALLEGRO_LOCKED_REGION* region = al_lock_bitmap(bitmap, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_WRITEONLY);
+	if (region) {
+		for (int y = 0; y < stream->height; y++) {
+			memcpy((unsigned char*)region->data + y * region->pitch, stream->pixels + y * stream->width * 4, stream->width * 4);
+		}
+		al_unlock_bitmap(bitmap);
+	}
+	stream->uploaded = stream->decoded;
+}
+
+static void Prefetch(struct Game* game, struct FrameStream* stream) {
+	// Keep the ring filled with the current frame and the ones right after it.
+	int target = stream->frame + FRAMESTREAM_RING - 1;
+	if (target >= stream->count) {
+		target = stream->count - 1;
+	}
+	while (stream->decoded < target) {
+		if (!DecodeFrame(stream)) {
+			// Stop on the last frame that decoded fine (it's still in the ring),
+			// rather than showing garbage.
+			PrintConsole(game, "Corrupted frame stream, stopping at frame %d.", stream->decoded);
+			stream->count = stream->decoded + 1;
+			if (stream->frame > stream->decoded) {
+				stream->frame = stream->decoded > 0 ? stream->decoded : 0;
+			}
+			stream->finished = true;
+			return;
+		}
+		if (stream->decoded >= stream->frame) {
+			UploadFrame(stream);
+		}
+	}
+}
+
+void RewindFrameStream(struct Game* game, struct FrameStream* stream) {
+	ResetDecoder(stream);
+	stream->time = 0;
+	stream->frame = 0;
+	stream->finished = false;
+	Prefetch(game, stream);
+}
+
+void UpdateFrameStream(struct Game* game, struct FrameStream* stream, double delta) {
+	if (stream->finished) {
+		return;
+	}
+	stream->time += delta;
+	while (stream->time >= stream->duration) {
+		stream->time -= stream->duration;
+		stream->frame++;
+		if (stream->frame >= stream->count) {
+			stream->frame = stream->count - 1;
+			stream->finished = true;
+			return;
+		}
+	}
+	Prefetch(game, stream);
+}
+
+void ReloadFrameStream(struct Game* game, struct FrameStream* stream) {
+	// Textures in the ring aren't preserved, so decode again up to the current
+	// frame from the encoded stream.
+	ResetDecoder(stream);
+	Prefetch(game, stream);
+}
+
+ALLEGRO_BITMAP* GetFrameStreamBitmap(struct Game* game, struct FrameStream* stream) {
+	return stream->ring[stream->frame % FRAMESTREAM_RING];
+}
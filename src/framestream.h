@@ -0,0 +1,29 @@
+#pragma once
+#include "common.h"
+
+#define FRAMESTREAM_RING 3
+
+struct FrameStream {
+	ALLEGRO_FILE* file; // encoded stream, as written by tools/framepack.c
+	int64_t size, offset; // offset of the next frame to decode
+	unsigned char* buffer; // encoded data of the frame being decoded, big enough for the largest one
+	int width, height, count;
+	double duration;
+
+	unsigned char* pixels; // last decoded frame
+	int decoded; // index of the frame in pixels, -1 when nothing was decoded yet
+
+	ALLEGRO_BITMAP* ring[FRAMESTREAM_RING]; // textures of the current frame and the ones just ahead of it
+	int uploaded; // last frame uploaded into the ring
+
+	double time;
+	int frame;
+	bool finished;
+};
+
+struct FrameStream* LoadFrameStream(struct Game* game, const char* filename);
+void DestroyFrameStream(struct Game* game, struct FrameStream* stream);
+void RewindFrameStream(struct Game* game, struct FrameStream* stream);
+void UpdateFrameStream(struct Game* game, struct FrameStream* stream, double delta);
+void ReloadFrameStream(struct Game* game, struct FrameStream* stream);
+ALLEGRO_BITMAP* GetFrameStreamBitmap(struct Game* game, struct FrameStream* stream);
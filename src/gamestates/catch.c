@@ -19,7 +19,15 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#include "../atlas.h"
+#include "../cache.h"
 #include "../common.h"
+#include "../idle.h"
+#include "../layers.h"
+#include "../loader.h"
+#include "../profiler.h"
+#include "../progress.h"
+#include "../trace.h"
 #include <allegro5/allegro_primitives.h>
 #include <libsuperderpy.h>
 #include <math.h>
@@ -29,7 +37,8 @@ struct GamestateResources {
 	// It gets created on load and then gets passed around to all other function calls.
 	ALLEGRO_FONT* font;
 	struct Character *bg, *hand, *glow, *key;
-	ALLEGRO_BITMAP* dell[6];
+	struct Atlas* atlas;
+	struct LayeredBitmap* dell;
 	int pos;
 	char ch;
 	ALLEGRO_SAMPLE* sample;
@@ -38,12 +47,11 @@ struct GamestateResources {
 	int keyposx, keyposy;
 };
 
-int Gamestate_ProgressCount = 11; // number of loading steps as reported by Gamestate_Load
+int Gamestate_ProgressCount = PROGRESS_TICKS; // see progress.c
 
-void Gamestate_Logic(struct Game* game, struct GamestateResources* data, double delta) {}
-
-void Gamestate_Tick(struct Game* game, struct GamestateResources* data) {
+static void Tick(struct Game* game, struct GamestateResources* data) {
 	// Called 60 times per second. Here you should do all your game logic.
+	PROFILE(game, "catch", PROFILE_TICK);
 	double delta = 1 / 60.0;
 	AnimateCharacter(game, data->bg, delta, 1);
 	AnimateCharacter(game, data->glow, delta, 1);
@@ -54,12 +62,12 @@ void Gamestate_Tick(struct Game* game, struct GamestateResources* data) {
 	}
 	if (data->pos >= 288) {
 		data->pos = 287;
-		SwitchCurrentGamestate(game, "notfine");
+		ChangeCurrentGamestate(game, "notfine");
 	}
 	//PrintConsole(game, "pos: %f, hand: %f, minus: %f", (float)data->pos, 300 + data->hand->x, 300 + data->hand->x - data->pos);
 
 	if (300 + GetCharacterX(game, data->hand) - data->pos > 10) {
-		SwitchCurrentGamestate(game, "fine");
+		ChangeCurrentGamestate(game, "fine");
 	}
 
 	if (game->data->touch) {
@@ -71,21 +79,36 @@ void Gamestate_Tick(struct Game* game, struct GamestateResources* data) {
 	}
 }
 
+void Gamestate_Logic(struct Game* game, struct GamestateResources* data, double delta) {
+	PROFILE(game, "catch", PROFILE_LOGIC);
+	if (game->data->headless) {
+		Tick(game, data); // one tick per frame, see EnableHeadless
+	}
+}
+
+void Gamestate_Tick(struct Game* game, struct GamestateResources* data) {
+	if (!game->data->headless) {
+		Tick(game, data);
+	}
+}
+
 void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
 	// Called as soon as possible, but no sooner than next Gamestate_Logic call.
 	// Draw everything to the screen here.
+	if (game->data->headless) {
+		return; // see EnableHeadless
+	}
+	PROFILE(game, "catch", PROFILE_DRAW);
 
-	DrawCharacter(game, data->bg);
+	DrawAtlasCharacter(game, data->atlas, data->bg, false);
 
 	int i = data->pos / 64 + 1;
 	float remainder = (data->pos / 64.0) - (i - 1);
-	al_draw_tinted_bitmap(data->dell[i - 1], al_map_rgba_f(1.0 - remainder, 1.0 - remainder, 1.0 - remainder, 1.0 - remainder), 0, 0, 0);
-	al_draw_bitmap(data->dell[i], 0, 0, 0);
+	DrawCrossfade(game, data->dell, i - 1, i, remainder, 0, 0);
 
-	DrawCharacter(game, data->hand);
+	DrawAtlasCharacter(game, data->atlas, data->hand, false);
 
-	DrawCharacter(game, data->glow);
-	DrawCharacter(game, data->glow);
+	DrawAtlasCharacter(game, data->atlas, data->glow, true);
 	DrawCharacter(game, data->key);
 
 #ifndef ALLEGRO_ANDROID
@@ -118,12 +141,13 @@ void MoveHand(struct Game* game, struct GamestateResources* data) {
 void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data, ALLEGRO_EVENT* ev) {
 	// Called for each event in Allegro event queue.
 	// Here you can handle user input, expiring timers etc.
+	PROFILE(game, "catch", PROFILE_EVENTS);
 	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_ESCAPE)) {
-		SwitchCurrentGamestate(game, "logo"); // mark this gamestate to be stopped and unloaded
+		ChangeCurrentGamestate(game, "logo"); // stays loaded for a quick restart
 		// When there are no active gamestates, the engine will quit.
 	}
 	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_BACK)) {
-		SwitchCurrentGamestate(game, "logo");
+		ChangeCurrentGamestate(game, "logo");
 		// When there are no active gamestates, the engine will quit.
 	}
 	if (ev->type == ALLEGRO_EVENT_KEY_DOWN) {
@@ -157,60 +181,67 @@ void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data,
 void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 	// Called once, when the gamestate library is being loaded.
 	// Good place for allocating memory, loading bitmaps etc.
+	TRACE("load", "catch");
 	struct GamestateResources* data = malloc(sizeof(struct GamestateResources));
-	data->font = al_create_builtin_font();
+	data->font = AcquireBuiltinFont(game);
+	progress = BeginProgress(game, "catch", progress, 11);
 	progress(game); // report that we progressed with the loading, so the engine can draw a progress bar
+
+	// the spritesheets found on the atlas page don't get loaded from their files
+	data->atlas = LoadAtlas(game, "atlas/catch/atlas.ini");
+
+	struct Loader* loader = CreateLoader(game);
 	data->bg = CreateCharacter(game, "bg");
 	RegisterSpritesheet(game, data->bg, "bg");
-	LoadSpritesheets(game, data->bg, progress);
-	progress(game);
+	UseAtlasSpritesheets(data->atlas, data->bg);
+	LoadSpritesheetsAsync(loader, data->bg);
 
 	data->hand = CreateCharacter(game, "hand");
 	RegisterSpritesheet(game, data->hand, "hand");
-	LoadSpritesheets(game, data->hand, progress);
-	progress(game);
+	UseAtlasSpritesheets(data->atlas, data->hand);
+	LoadSpritesheetsAsync(loader, data->hand);
 
 	data->glow = CreateCharacter(game, "glow");
 	RegisterSpritesheet(game, data->glow, "glow");
+	UseAtlasSpritesheets(data->atlas, data->glow);
+	LoadSpritesheetsAsync(loader, data->glow);
+
+	LoadSampleAsync(loader, &data->sample, "bdzium.flac");
+
+	// meanwhile, keep this thread busy too
+	data->dell = LoadLayeredBitmap(game, (const char*[]){"dell0.png", "dell1.png", "dell2.png", "dell3.png", "dell4.png", "dell5.png"}, 6);
+	FinishLoader(loader);
+
+	LoadSpritesheets(game, data->bg, progress);
+	progress(game);
+	LoadSpritesheets(game, data->hand, progress);
+	progress(game);
 	LoadSpritesheets(game, data->glow, progress);
 	progress(game);
-
-	data->key = CreateCharacter(game, "key");
-	RegisterSpritesheet(game, data->key, "ready");
-	RegisterSpritesheet(game, data->key, "pressed");
-	LoadSpritesheets(game, data->key, progress);
+	data->key = AcquireCharacter(game, "key", (char*[]){"ready", "pressed", NULL}, progress);
 	progress(game);
 
-	data->ch = 'a' + (rand() % ('z' - 'a'));
-	data->keyposx = rand() % (game->viewport.width - al_get_bitmap_width(data->key->spritesheets->bitmap));
-	data->keyposy = game->viewport.height / 2 + rand() % (game->viewport.height / 2 - al_get_bitmap_height(data->key->spritesheets->bitmap));
-
-	data->dell[0] = al_load_bitmap(GetDataFilePath(game, "dell0.png"));
-	data->dell[1] = al_load_bitmap(GetDataFilePath(game, "dell1.png"));
-	data->dell[2] = al_load_bitmap(GetDataFilePath(game, "dell2.png"));
-	data->dell[3] = al_load_bitmap(GetDataFilePath(game, "dell3.png"));
-	data->dell[4] = al_load_bitmap(GetDataFilePath(game, "dell4.png"));
-	data->dell[5] = al_load_bitmap(GetDataFilePath(game, "dell5.png"));
 	progress(game);
 
-	data->sample = al_load_sample(GetDataFilePath(game, "bdzium.flac"));
 	data->sound = al_create_sample_instance(data->sample);
 	al_attach_sample_instance_to_mixer(data->sound, game->audio.fx);
 
+	EndProgress(game);
 	return data;
 }
 
 void Gamestate_Unload(struct Game* game, struct GamestateResources* data) {
 	// Called when the gamestate library is being unloaded.
 	// Good place for freeing all allocated memory and resources.
-	al_destroy_font(data->font);
+	ReleaseAsset(game, data->font);
 	DestroyCharacter(game, data->bg);
 	DestroyCharacter(game, data->hand);
 	DestroyCharacter(game, data->glow);
-	DestroyCharacter(game, data->key);
-	for (int i = 0; i < 6; i++) {
-		al_destroy_bitmap(data->dell[i]);
+	if (data->atlas) {
+		DestroyAtlas(data->atlas);
 	}
+	ReleaseCharacter(game, data->key);
+	DestroyLayeredBitmap(data->dell);
 	al_destroy_sample_instance(data->sound);
 	al_destroy_sample(data->sample);
 	free(data);
@@ -219,6 +250,11 @@ void Gamestate_Unload(struct Game* game, struct GamestateResources* data) {
 void Gamestate_Start(struct Game* game, struct GamestateResources* data) {
 	// Called when this gamestate gets control. Good place for initializing state,
 	// playing music etc.
+	IdleStart(game);
+	data->ch = 'a' + (rand() % ('z' - 'a'));
+	data->keyposx = rand() % (game->viewport.width - al_get_bitmap_width(data->key->spritesheets->bitmap));
+	data->keyposy = game->viewport.height / 2 + rand() % (game->viewport.height / 2 - al_get_bitmap_height(data->key->spritesheets->bitmap));
+
 	SelectSpritesheet(game, data->bg, "bg");
 	SetCharacterPosition(game, data->bg, 0, 0, 0);
 	SelectSpritesheet(game, data->hand, "hand");
@@ -238,6 +274,7 @@ void Gamestate_Start(struct Game* game, struct GamestateResources* data) {
 
 void Gamestate_Stop(struct Game* game, struct GamestateResources* data) {
 	// Called when gamestate gets stopped. Stop timers, music etc. here.
+	IdleStop(game);
 }
 
 // Ignore those for now.
@@ -19,6 +19,12 @@
  */
 
 #include "../common.h"
+#include "../idle.h"
+#include "../pack.h"
+#include "../postfx.h"
+#include "../preload.h"
+#include "../profiler.h"
+#include "../trace.h"
 #include <libsuperderpy.h>
 #include <math.h>
 
@@ -28,7 +34,6 @@ struct GamestateResources {
 	ALLEGRO_FONT* font;
 	ALLEGRO_SAMPLE *sample, *kbd_sample, *key_sample;
 	ALLEGRO_SAMPLE_INSTANCE *sound, *kbd, *key;
-	ALLEGRO_BITMAP *bitmap, *checkerboard, *pixelator;
 	int pos;
 	double fade, tan;
 	char text[255];
@@ -41,7 +46,7 @@ int Gamestate_ProgressCount = 5;
 static const char* text = "# dosowisko.net";
 
 //==================================Timeline manager actions BEGIN
-static TM_ACTION(FadeIn) {
+TRACED_ACTION(FadeIn) {
 	switch (action->state) {
 		case TM_ACTIONSTATE_START:
 			data->fade = 0;
@@ -58,25 +63,25 @@ static TM_ACTION(FadeIn) {
 	}
 }
 
-static TM_ACTION(FadeOut) {
+TRACED_ACTION(FadeOut) {
 	TM_RunningOnly;
 	data->fadeout = true;
 	return true;
 }
 
-static TM_ACTION(End) {
+TRACED_ACTION(End) {
 	TM_RunningOnly;
 	SwitchCurrentGamestate(game, NEXT_GAMESTATE);
 	return true;
 }
 
-static TM_ACTION(Play) {
+TRACED_ACTION(Play) {
 	TM_RunningOnly;
 	al_play_sample_instance(TM_Arg(0));
 	return true;
 }
 
-static TM_ACTION(Type) {
+TRACED_ACTION(Type) {
 	TM_RunningOnly;
 	strncpy(data->text, text, data->pos++);
 	data->text[data->pos] = 0;
@@ -90,11 +95,20 @@ static TM_ACTION(Type) {
 //==================================Timeline manager actions END
 
 void Gamestate_Logic(struct Game* game, struct GamestateResources* data, double delta) {
-	TM_Process(data->timeline, delta);
+	PROFILE(game, "dosowisko", PROFILE_LOGIC);
+	delta = SimulationDelta(game, delta);
+	{
+		PROFILE(game, "dosowisko", PROFILE_TIMELINE);
+		TM_Process(data->timeline, delta);
+	}
 	data->underscore = Fract(game->time) >= 0.5;
 }
 
 void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
+	if (game->data->headless) {
+		return; // see EnableHeadless
+	}
+	PROFILE(game, "dosowisko", PROFILE_DRAW);
 	if (!data->fadeout) {
 		char t[255] = "";
 		strncpy(t, data->text, 255);
@@ -104,7 +118,8 @@ void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
 			strncat(t, " ", 2);
 		}
 
-		al_set_target_bitmap(data->bitmap);
+		ALLEGRO_BITMAP* bitmap = AcquireRenderTarget(game, true);
+		al_set_target_bitmap(bitmap);
 		al_clear_to_color(al_map_rgba(0, 0, 0, 0));
 
 		al_draw_text(data->font, al_map_rgba(255, 255, 255, 10), 320 / 2.0,
@@ -114,26 +129,20 @@ void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
 
 		int fade = data->fadeout ? 255 : (int)(data->fade);
 
-		al_set_target_bitmap(data->pixelator);
+		BeginPixelated(game);
 		al_clear_to_color(al_map_rgb(35, 31, 32));
 
-		al_draw_tinted_scaled_bitmap(data->bitmap, al_map_rgba(fade, fade, fade, fade), 0, 0,
-			al_get_bitmap_width(data->bitmap), al_get_bitmap_height(data->bitmap),
-			-tg * al_get_bitmap_width(data->bitmap) * 0.05,
-			-tg * al_get_bitmap_height(data->bitmap) * 0.05,
-			al_get_bitmap_width(data->bitmap) + tg * 0.1 * al_get_bitmap_width(data->bitmap),
-			al_get_bitmap_height(data->bitmap) + tg * 0.1 * al_get_bitmap_height(data->bitmap),
-			0);
-
-		al_draw_bitmap(data->checkerboard, 0, 0, 0);
+		DrawZoomed(bitmap, al_map_rgba(fade, fade, fade, fade), -tg * 320 * 0.05, -tg * 180 * 0.05, 1 + tg * 0.1);
+		ReleaseRenderTarget(bitmap);
 
-		SetFramebufferAsTarget(game);
+		DrawCheckerboard(game);
 
-		al_draw_scaled_bitmap(data->pixelator, 0, 0, 320, 180, 0, 0, game->viewport.width, game->viewport.height, 0);
+		EndPixelated(game);
 	}
 }
 
 void Gamestate_Start(struct Game* game, struct GamestateResources* data) {
+	IdleStart(game);
 	data->pos = 1;
 	data->fade = 0;
 	data->tan = 64;
@@ -155,6 +164,7 @@ void Gamestate_Start(struct Game* game, struct GamestateResources* data) {
 }
 
 void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data, ALLEGRO_EVENT* ev) {
+	PROFILE(game, "dosowisko", PROFILE_EVENTS);
 	if (((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_ESCAPE)) || (ev->type == ALLEGRO_EVENT_TOUCH_END)) {
 		UnloadAllGamestates(game);
 		StartGame(game, false);
@@ -162,33 +172,31 @@ void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data,
 }
 
 void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
+	TRACE("load", "dosowisko");
 	struct GamestateResources* data = malloc(sizeof(struct GamestateResources));
 	int flags = al_get_new_bitmap_flags();
 	al_set_new_bitmap_flags(flags ^ ALLEGRO_MAG_LINEAR);
 
 	data->timeline = TM_Init(game, data, "main");
-	data->bitmap = CreateNotPreservedBitmap(320, 180);
-	data->pixelator = CreateNotPreservedBitmap(320, 180);
-	data->checkerboard = al_create_bitmap(320, 180);
 	(*progress)(game);
 
-	data->font = al_load_ttf_font(GetDataFilePath(game, "fonts/DejaVuSansMono.ttf"),
+	data->font = LoadAssetFont(game, "fonts/DejaVuSansMono.ttf",
 		(int)(180 * 0.1666 / 8) * 8, 0);
 	(*progress)(game);
 
-	data->sample = al_load_sample(GetDataFilePath(game, "dosowisko.flac"));
+	data->sample = LoadPreloadedSample(game, "dosowisko.flac");
 	data->sound = al_create_sample_instance(data->sample);
 	al_attach_sample_instance_to_mixer(data->sound, game->audio.music);
 	al_set_sample_instance_playmode(data->sound, ALLEGRO_PLAYMODE_ONCE);
 	(*progress)(game);
 
-	data->kbd_sample = al_load_sample(GetDataFilePath(game, "kbd.flac"));
+	data->kbd_sample = LoadPreloadedSample(game, "kbd.flac");
 	data->kbd = al_create_sample_instance(data->kbd_sample);
 	al_attach_sample_instance_to_mixer(data->kbd, game->audio.fx);
 	al_set_sample_instance_playmode(data->kbd, ALLEGRO_PLAYMODE_ONCE);
 	(*progress)(game);
 
-	data->key_sample = al_load_sample(GetDataFilePath(game, "key.flac"));
+	data->key_sample = LoadPreloadedSample(game, "key.flac");
 	data->key = al_create_sample_instance(data->key_sample);
 	al_attach_sample_instance_to_mixer(data->key, game->audio.fx);
 	al_set_sample_instance_playmode(data->key, ALLEGRO_PLAYMODE_ONCE);
@@ -199,23 +207,8 @@ void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 	return data;
 }
 
-void Gamestate_PostLoad(struct Game* game, struct GamestateResources* data) {
-	al_set_target_bitmap(data->checkerboard);
-	al_lock_bitmap(data->checkerboard, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_WRITEONLY);
-	int x, y;
-	for (x = 0; x < al_get_bitmap_width(data->checkerboard); x = x + 2) {
-		for (y = 0; y < al_get_bitmap_height(data->checkerboard); y = y + 2) {
-			al_put_pixel(x, y, al_map_rgba(0, 0, 0, 64));
-			al_put_pixel(x + 1, y, al_map_rgba(0, 0, 0, 0));
-			al_put_pixel(x, y + 1, al_map_rgba(0, 0, 0, 0));
-			al_put_pixel(x + 1, y + 1, al_map_rgba(0, 0, 0, 0));
-		}
-	}
-	al_unlock_bitmap(data->checkerboard);
-	al_set_target_backbuffer(game->display);
-}
-
 void Gamestate_Stop(struct Game* game, struct GamestateResources* data) {
+	IdleStop(game);
 	al_stop_sample_instance(data->sound);
 	al_stop_sample_instance(data->kbd);
 	al_stop_sample_instance(data->key);
@@ -229,17 +222,8 @@ void Gamestate_Unload(struct Game* game, struct GamestateResources* data) {
 	al_destroy_sample(data->kbd_sample);
 	al_destroy_sample_instance(data->key);
 	al_destroy_sample(data->key_sample);
-	al_destroy_bitmap(data->bitmap);
-	al_destroy_bitmap(data->checkerboard);
-	al_destroy_bitmap(data->pixelator);
 	TM_Destroy(data->timeline);
 	free(data);
 }
 
-void Gamestate_Reload(struct Game* game, struct GamestateResources* data) {
-	int flags = al_get_new_bitmap_flags();
-	al_set_new_bitmap_flags(flags ^ ALLEGRO_MAG_LINEAR);
-	data->bitmap = CreateNotPreservedBitmap(320, 180);
-	data->pixelator = CreateNotPreservedBitmap(320, 180);
-	al_set_new_bitmap_flags(flags);
-}
+void Gamestate_Reload(struct Game* game, struct GamestateResources* data) {}
@@ -19,6 +19,12 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#include "../common.h"
+#include "../framestream.h"
+#include "../idle.h"
+#include "../loader.h"
+#include "../profiler.h"
+#include "../trace.h"
 #include <allegro5/allegro_primitives.h>
 #include <libsuperderpy.h>
 #include <math.h>
@@ -26,6 +32,7 @@
 struct GamestateResources {
 	// This struct is for every resource allocated and used by your gamestate.
 	// It gets created on load and then gets passed around to all other function calls.
+	struct FrameStream* stream; // decoded on the fly; NULL when falling back to the spritesheet
 	struct Character* maks;
 	ALLEGRO_SAMPLE* sample;
 	ALLEGRO_SAMPLE_INSTANCE* sound;
@@ -33,34 +40,63 @@ struct GamestateResources {
 
 int Gamestate_ProgressCount = 4; // number of loading steps as reported by Gamestate_Load
 
-void Gamestate_Logic(struct Game* game, struct GamestateResources* data, double delta) {}
-
-void Gamestate_Tick(struct Game* game, struct GamestateResources* data) {
+static void Tick(struct Game* game, struct GamestateResources* data) {
 	// Called 60 times per second. Here you should do all your game logic.
+	PROFILE(game, "fall", PROFILE_TICK);
 	double delta = 1 / 60.0;
+	if (data->stream) {
+		UpdateFrameStream(game, data->stream, delta);
+		if (data->stream->finished) {
+			ChangeCurrentGamestate(game, "catch");
+		}
+		return;
+	}
+
 	AnimateCharacter(game, data->maks, delta, 1);
 
 	if (!data->maks->successor) {
-		SwitchCurrentGamestate(game, "catch");
+		ChangeCurrentGamestate(game, "catch");
+	}
+}
+
+void Gamestate_Logic(struct Game* game, struct GamestateResources* data, double delta) {
+	PROFILE(game, "fall", PROFILE_LOGIC);
+	if (game->data->headless) {
+		Tick(game, data); // one tick per frame, see EnableHeadless
+	}
+}
+
+void Gamestate_Tick(struct Game* game, struct GamestateResources* data) {
+	if (!game->data->headless) {
+		Tick(game, data);
 	}
 }
 
 void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
 	// Called as soon as possible, but no sooner than next Gamestate_Logic call.
 	// Draw everything to the screen here.
+	if (game->data->headless) {
+		return; // see EnableHeadless
+	}
+	PROFILE(game, "fall", PROFILE_DRAW);
 
+	if (data->stream) {
+		al_draw_bitmap(GetFrameStreamBitmap(game, data->stream), 0, 0, 0);
+		return;
+	}
 	DrawCharacter(game, data->maks);
 }
 
 void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data, ALLEGRO_EVENT* ev) {
 	// Called for each event in Allegro event queue.
 	// Here you can handle user input, expiring timers etc.
+	PROFILE(game, "fall", PROFILE_EVENTS);
 	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_ESCAPE)) {
-		SwitchCurrentGamestate(game, "logo");
+		ChangeCurrentGamestate(game, "logo");
 		// When there are no active gamestates, the engine will quit.
 	}
 	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_BACK)) {
-		SwitchCurrentGamestate(game, "logo");
+		ChangeCurrentGamestate(game, "logo");
 		// When there are no active gamestates, the engine will quit.
 	}
 }
@@ -68,15 +104,31 @@ void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data,
 void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 	// Called once, when the gamestate library is being loaded.
 	// Good place for allocating memory, loading bitmaps etc.
+	TRACE("load", "fall");
 	struct GamestateResources* data = malloc(sizeof(struct GamestateResources));
 	progress(game); // report that we progressed with the loading, so the engine can draw a progress bar
-	data->maks = CreateCharacter(game, "fall");
-	RegisterSpritesheet(game, data->maks, "fall");
-	RegisterSpritesheet(game, data->maks, "blank");
-	LoadSpritesheets(game, data->maks, progress);
+
+	// The whole fall.png spritesheet takes over 10 MB of VRAM, so prefer the stream
+	// generated at build time by tools/framepack.c.
+	struct Loader* loader = CreateLoader(game);
+	LoadSampleAsync(loader, &data->sample, "fall.flac");
+
+	data->stream = LoadFrameStream(game, "frames/fall.frames");
+	data->maks = NULL;
+	if (data->stream) {
+		FinishLoader(loader);
+		progress(game);
+		progress(game);
+	} else {
+		data->maks = CreateCharacter(game, "fall");
+		RegisterSpritesheet(game, data->maks, "fall");
+		RegisterSpritesheet(game, data->maks, "blank");
+		LoadSpritesheetsAsync(loader, data->maks);
+		FinishLoader(loader);
+		LoadSpritesheets(game, data->maks, progress);
+	}
 	progress(game);
 
-	data->sample = al_load_sample(GetDataFilePath(game, "fall.flac"));
 	data->sound = al_create_sample_instance(data->sample);
 	al_attach_sample_instance_to_mixer(data->sound, game->audio.fx);
 
@@ -86,7 +138,11 @@ void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 void Gamestate_Unload(struct Game* game, struct GamestateResources* data) {
 	// Called when the gamestate library is being unloaded.
 	// Good place for freeing all allocated memory and resources.
-	DestroyCharacter(game, data->maks);
+	if (data->stream) {
+		DestroyFrameStream(game, data->stream);
+	} else {
+		DestroyCharacter(game, data->maks);
+	}
 	al_destroy_sample_instance(data->sound);
 	al_destroy_sample(data->sample);
 	free(data);
@@ -95,13 +151,19 @@ void Gamestate_Unload(struct Game* game, struct GamestateResources* data) {
 void Gamestate_Start(struct Game* game, struct GamestateResources* data) {
 	// Called when this gamestate gets control. Good place for initializing state,
 	// playing music etc.
-	SelectSpritesheet(game, data->maks, "fall");
-	SetCharacterPosition(game, data->maks, 0, 0, 0);
+	IdleStart(game);
+	if (data->stream) {
+		RewindFrameStream(game, data->stream);
+	} else {
+		SelectSpritesheet(game, data->maks, "fall");
+		SetCharacterPosition(game, data->maks, 0, 0, 0);
+	}
 	al_play_sample_instance(data->sound);
 }
 
 void Gamestate_Stop(struct Game* game, struct GamestateResources* data) {
 	// Called when gamestate gets stopped. Stop timers, music etc. here.
+	IdleStop(game);
 	al_stop_sample_instance(data->sound);
 }
 
@@ -19,7 +19,13 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#include "../cache.h"
 #include "../common.h"
+#include "../idle.h"
+#include "../pack.h"
+#include "../profiler.h"
+#include "../text.h"
+#include "../trace.h"
 #include <allegro5/allegro_primitives.h>
 #include <libsuperderpy.h>
 #include <math.h>
@@ -29,6 +35,7 @@ struct GamestateResources {
 	// This struct is for every resource allocated and used by your gamestate.
 	// It gets created on load and then gets passed around to all other function calls.
 	ALLEGRO_FONT* font;
+	struct CachedText *caption, *score;
 	ALLEGRO_BITMAP* bitmap;
 	ALLEGRO_AUDIO_STREAM* fine;
 	ALLEGRO_SAMPLE* sample;
@@ -44,14 +51,16 @@ void Gamestate_Tick(struct Game* game, struct GamestateResources* data) {}
 void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
 	// Called as soon as possible, but no sooner than next Gamestate_Logic call.
 	// Draw everything to the screen here.
+	if (game->data->headless) {
+		return; // see EnableHeadless
+	}
+	PROFILE(game, "fine", PROFILE_DRAW);
+	KeepFrame(game, INFINITY);
 
 	al_draw_bitmap(data->bitmap, 0, 0, 0);
 
-	char score[255];
-	snprintf(score, 255, "Score: %d", game->data->score * 100);
-
-	DrawTextWithShadow(data->font, al_map_rgb(255, 255, 255), 320 / 2, 140, ALLEGRO_ALIGN_CENTER, "Computer is fine! :)");
-	DrawTextWithShadow(data->font, al_map_rgb(255, 255, 255), 320 / 2, 7, ALLEGRO_ALIGN_CENTER, score);
+	DrawCachedText(game, data->caption, 320 / 2, 140, ALLEGRO_ALIGN_CENTER);
+	DrawCachedText(game, data->score, 320 / 2, 7, ALLEGRO_ALIGN_CENTER);
 }
 
 void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data, ALLEGRO_EVENT* ev) {
@@ -62,18 +71,22 @@ void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data,
 void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 	// Called once, when the gamestate library is being loaded.
 	// Good place for allocating memory, loading bitmaps etc.
+	TRACE("load", "fine");
 	struct GamestateResources* data = malloc(sizeof(struct GamestateResources));
-	data->font = al_create_builtin_font();
+	data->font = AcquireBuiltinFont(game);
+	data->caption = CreateCachedText(game, data->font, al_map_rgb(255, 255, 255), true);
+	SetCachedText(data->caption, "Computer is fine! :)");
+	data->score = CreateCachedText(game, data->font, al_map_rgb(255, 255, 255), true);
 	progress(game); // report that we progressed with the loading, so the engine can draw a progress bar
-	data->bitmap = al_load_bitmap(GetDataFilePath(game, "fine.png"));
+	data->bitmap = AcquireBitmap(game, "fine.png");
 	progress(game);
 
-	data->fine = al_load_audio_stream(GetDataFilePath(game, "cif.flac"), 4, 1024);
+	data->fine = LoadAssetStream(game, "cif.flac", 4, 1024);
 	al_set_audio_stream_playing(data->fine, false);
 	al_attach_audio_stream_to_mixer(data->fine, game->audio.voice);
 	progress(game);
 
-	data->sample = al_load_sample(GetDataFilePath(game, "end.flac"));
+	data->sample = AcquireSample(game, "end.flac");
 	data->end = al_create_sample_instance(data->sample);
 	al_attach_sample_instance_to_mixer(data->end, game->audio.fx);
 
@@ -85,10 +98,12 @@ void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 void Gamestate_Unload(struct Game* game, struct GamestateResources* data) {
 	// Called when the gamestate library is being unloaded.
 	// Good place for freeing all allocated memory and resources.
-	al_destroy_font(data->font);
-	al_destroy_bitmap(data->bitmap);
+	DestroyCachedText(data->caption);
+	DestroyCachedText(data->score);
+	ReleaseAsset(game, data->font);
+	ReleaseAsset(game, data->bitmap);
 	al_destroy_audio_stream(data->fine);
-	al_destroy_sample(data->sample);
+	ReleaseAsset(game, data->sample);
 	al_destroy_sample_instance(data->end);
 	free(data);
 }
@@ -96,6 +111,10 @@ void Gamestate_Unload(struct Game* game, struct GamestateResources* data) {
 void Gamestate_Start(struct Game* game, struct GamestateResources* data) {
 	// Called when this gamestate gets control. Good place for initializing state,
 	// playing music etc.
+	IdleStart(game);
+	char score[255];
+	snprintf(score, 255, "Score: %d", game->data->score * 100);
+	SetCachedText(data->score, score);
 	al_set_audio_stream_playing(data->fine, true);
 	al_play_sample_instance(data->end);
 	StartGamestate(game, "menu");
@@ -103,6 +122,7 @@ void Gamestate_Start(struct Game* game, struct GamestateResources* data) {
 
 void Gamestate_Stop(struct Game* game, struct GamestateResources* data) {
 	// Called when gamestate gets stopped. Stop timers, music etc. here.
+	IdleStop(game);
 	al_set_audio_stream_playing(data->fine, false);
 	StopGamestate(game, "menu");
 }
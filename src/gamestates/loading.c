@@ -19,6 +19,7 @@
  */
 
 #include "../common.h"
+#include "../trace.h"
 #include <libsuperderpy.h>
 
 /*! \brief Resources used by Loading state. */
@@ -33,11 +34,15 @@ void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data,
 void Gamestate_Logic(struct Game* game, struct GamestateResources* data, double delta){};
 
 void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
+	if (game->data && game->data->headless) {
+		return; // see EnableHeadless
+	}
 	al_draw_filled_rectangle(0, game->viewport.height * 0.98, game->viewport.width, game->viewport.height, al_map_rgba(32, 32, 32, 32));
 	al_draw_filled_rectangle(0, game->viewport.height * 0.98, game->loading.progress * game->viewport.width, game->viewport.height, al_map_rgba(128, 128, 128, 128));
 };
 
 void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
+	TRACE("load", "loading");
 	struct GamestateResources* data = malloc(sizeof(struct GamestateResources));
 	return data;
 }
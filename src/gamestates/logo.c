@@ -19,7 +19,12 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#include "../cache.h"
 #include "../common.h"
+#include "../idle.h"
+#include "../profiler.h"
+#include "../text.h"
+#include "../trace.h"
 #include <allegro5/allegro_primitives.h>
 #include <libsuperderpy.h>
 #include <math.h>
@@ -28,26 +33,42 @@ struct GamestateResources {
 	// This struct is for every resource allocated and used by your gamestate.
 	// It gets created on load and then gets passed around to all other function calls.
 	ALLEGRO_FONT* font;
+	struct CachedText* caption;
 	ALLEGRO_BITMAP *bitmap, *bg;
 	float pos;
 };
 
 int Gamestate_ProgressCount = 2; // number of loading steps as reported by Gamestate_Load
 
-void Gamestate_Logic(struct Game* game, struct GamestateResources* data, double delta) {}
-
-void Gamestate_Tick(struct Game* game, struct GamestateResources* data) {
+static void Tick(struct Game* game, struct GamestateResources* data) {
 	// Called 60 times per second. Here you should do all your game logic.
+	PROFILE(game, "logo", PROFILE_TICK);
 	data->pos += 0.1;
 }
 
+void Gamestate_Logic(struct Game* game, struct GamestateResources* data, double delta) {
+	PROFILE(game, "logo", PROFILE_LOGIC);
+	if (game->data->headless) {
+		Tick(game, data); // one tick per frame, see EnableHeadless
+	}
+}
+
+void Gamestate_Tick(struct Game* game, struct GamestateResources* data) {
+	if (!game->data->headless) {
+		Tick(game, data);
+	}
+}
+
 void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
 	// Called as soon as possible, but no sooner than next Gamestate_Logic call.
 	// Draw everything to the screen here.
+	if (game->data->headless) {
+		return; // see EnableHeadless
+	}
+	PROFILE(game, "logo", PROFILE_DRAW);
 	al_draw_bitmap(data->bg, 0, 0, 0);
 	al_draw_bitmap(data->bitmap, 112, 29 + (int)(10 * sin(data->pos)), 0);
-	DrawTextWithShadow(data->font, al_map_rgb(255, 255, 255), 320 / 2, 124, ALLEGRO_ALIGN_CENTER, "by dos");
-	DrawTextWithShadow(data->font, al_map_rgb(255, 255, 255), 320 / 2, 140, ALLEGRO_ALIGN_CENTER, "Based on a real story!");
+	DrawCachedText(game, data->caption, 320 / 2, 124, ALLEGRO_ALIGN_CENTER);
 }
 
 void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data, ALLEGRO_EVENT* ev) {
@@ -58,11 +79,14 @@ void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data,
 void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 	// Called once, when the gamestate library is being loaded.
 	// Good place for allocating memory, loading bitmaps etc.
+	TRACE("load", "logo");
 	struct GamestateResources* data = malloc(sizeof(struct GamestateResources));
-	data->font = al_create_builtin_font();
+	data->font = AcquireBuiltinFont(game);
+	data->caption = CreateCachedText(game, data->font, al_map_rgb(255, 255, 255), true);
+	SetCachedTextParts(data->caption, 2, (struct TextPart[]){{"by dos", (al_get_text_width(data->font, "Based on a real story!") - al_get_text_width(data->font, "by dos")) / 2, 0}, {"Based on a real story!", 0, 16}});
 	progress(game); // report that we progressed with the loading, so the engine can draw a progress bar
-	data->bitmap = al_load_bitmap(GetDataFilePath(game, "logo.png"));
-	data->bg = al_load_bitmap(GetDataFilePath(game, "logobg.png"));
+	data->bitmap = AcquireBitmap(game, "logo.png");
+	data->bg = AcquireBitmap(game, "logobg.png");
 	progress(game);
 
 	LoadGamestate(game, "menu");
@@ -72,15 +96,17 @@ void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 void Gamestate_Unload(struct Game* game, struct GamestateResources* data) {
 	// Called when the gamestate library is being unloaded.
 	// Good place for freeing all allocated memory and resources.
-	al_destroy_font(data->font);
-	al_destroy_bitmap(data->bitmap);
-	al_destroy_bitmap(data->bg);
+	DestroyCachedText(data->caption);
+	ReleaseAsset(game, data->font);
+	ReleaseAsset(game, data->bitmap);
+	ReleaseAsset(game, data->bg);
 	free(data);
 }
 
 void Gamestate_Start(struct Game* game, struct GamestateResources* data) {
 	// Called when this gamestate gets control. Good place for initializing state,
 	// playing music etc.
+	IdleStart(game);
 	game->data->logo = true;
 	data->pos = 0;
 	StartGamestate(game, "menu");
@@ -88,6 +114,7 @@ void Gamestate_Start(struct Game* game, struct GamestateResources* data) {
 
 void Gamestate_Stop(struct Game* game, struct GamestateResources* data) {
 	// Called when gamestate gets stopped. Stop timers, music etc. here.
+	IdleStop(game);
 	game->data->logo = false;
 	StopGamestate(game, "menu");
 }
@@ -19,7 +19,12 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#include "../cache.h"
 #include "../common.h"
+#include "../idle.h"
+#include "../profiler.h"
+#include "../text.h"
+#include "../trace.h"
 #include <allegro5/allegro_primitives.h>
 #include <libsuperderpy.h>
 #include <math.h>
@@ -29,16 +34,18 @@ struct GamestateResources {
 	// This struct is for every resource allocated and used by your gamestate.
 	// It gets created on load and then gets passed around to all other function calls.
 	ALLEGRO_FONT* font;
+	struct CachedText *label, *left, *right; // with touch controls
+	struct CachedText* framed; // with the arrows around, for keyboards
 	int option, blink;
+	int shown; // option in the cached texts
 	int offset;
 };
 
 int Gamestate_ProgressCount = 1; // number of loading steps as reported by Gamestate_Load
 
-void Gamestate_Logic(struct Game* game, struct GamestateResources* data, double delta) {}
-
-void Gamestate_Tick(struct Game* game, struct GamestateResources* data) {
+static void Tick(struct Game* game, struct GamestateResources* data) {
 	// Called 60 times per second. Here you should do all your game logic.
+	PROFILE(game, "menu", PROFILE_TICK);
 	data->blink++;
 	if (data->blink >= 60) {
 		data->blink = 0;
@@ -48,13 +55,35 @@ void Gamestate_Tick(struct Game* game, struct GamestateResources* data) {
 	}
 }
 
+void Gamestate_Logic(struct Game* game, struct GamestateResources* data, double delta) {
+	PROFILE(game, "menu", PROFILE_LOGIC);
+	if (game->data->headless) {
+		Tick(game, data); // one tick per frame, see EnableHeadless
+	}
+}
+
+void Gamestate_Tick(struct Game* game, struct GamestateResources* data) {
+	if (!game->data->headless) {
+		Tick(game, data);
+	}
+}
+
 void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
 	// Called as soon as possible, but no sooner than next Gamestate_Logic call.
 	// Draw everything to the screen here.
+	if (game->data->headless) {
+		return; // see EnableHeadless
+	}
+	PROFILE(game, "menu", PROFILE_DRAW);
 
 	int dy = data->offset;
 	if (!game->data->touch) dy = 0;
 
+	if (!dy) {
+		// only changes when blinking
+		KeepFrame(game, ((data->blink < 45 ? 45 : 60) - data->blink) / 60.0);
+	}
+
 	al_draw_filled_rectangle(0, 158 + dy, 320, 180, al_map_rgba(0, 0, 0, 64));
 
 	const char* texts[] = {"Play again", "Options", "Extras", "Quit",
@@ -63,14 +92,19 @@ void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
 		"Check out Chimpology", "Check out KARCZOCH", "Check out all SGJ16 games", "Back"};
 
 	if (data->blink < 45) {
-		if (game->data->touch) {
-			DrawTextWithShadow(data->font, al_map_rgb(255, 255, 255), 320 / 2, 165 + dy, ALLEGRO_ALIGN_CENTER, texts[data->option]);
-			DrawTextWithShadow(data->font, al_map_rgb(255, 255, 255), 10, 165 + dy, ALLEGRO_ALIGN_LEFT, "<");
-			DrawTextWithShadow(data->font, al_map_rgb(255, 255, 255), 310, 165 + dy, ALLEGRO_ALIGN_RIGHT, ">");
-		} else {
+		if (data->shown != data->option) {
 			char text[255];
 			snprintf(text, 255, "< %s >", texts[data->option]);
-			DrawTextWithShadow(data->font, al_map_rgb(255, 255, 255), 320 / 2, 165, ALLEGRO_ALIGN_CENTER, text);
+			SetCachedText(data->framed, text);
+			SetCachedText(data->label, texts[data->option]);
+			data->shown = data->option;
+		}
+		if (game->data->touch) {
+			DrawCachedText(game, data->label, 320 / 2, 165 + dy, ALLEGRO_ALIGN_CENTER);
+			DrawCachedText(game, data->left, 10, 165 + dy, ALLEGRO_ALIGN_LEFT);
+			DrawCachedText(game, data->right, 310, 165 + dy, ALLEGRO_ALIGN_RIGHT);
+		} else {
+			DrawCachedText(game, data->framed, 320 / 2, 165, ALLEGRO_ALIGN_CENTER);
 		}
 	}
 }
@@ -97,8 +131,7 @@ void MenuSelect(struct Game* game, struct GamestateResources* data) {
 	data->blink = 0;
 	switch (data->option) {
 		case 0:
-			UnloadAllGamestates(game);
-			StartGame(game, !game->data->logo);
+			RestartGame(game, !game->data->logo);
 			break;
 		case 1:
 			data->option = 4;
@@ -226,6 +259,7 @@ void MenuEscape(struct Game* game, struct GamestateResources* data) {
 void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data, ALLEGRO_EVENT* ev) {
 	// Called for each event in Allegro event queue.
 	// Here you can handle user input, expiring timers etc.
+	PROFILE(game, "menu", PROFILE_EVENTS);
 	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_ESCAPE)) {
 		MenuEscape(game, data);
 	}
@@ -316,8 +350,16 @@ void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data,
 void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 	// Called once, when the gamestate library is being loaded.
 	// Good place for allocating memory, loading bitmaps etc.
+	TRACE("load", "menu");
 	struct GamestateResources* data = malloc(sizeof(struct GamestateResources));
-	data->font = al_create_builtin_font();
+	data->font = AcquireBuiltinFont(game);
+	data->label = CreateCachedText(game, data->font, al_map_rgb(255, 255, 255), true);
+	data->framed = CreateCachedText(game, data->font, al_map_rgb(255, 255, 255), true);
+	data->left = CreateCachedText(game, data->font, al_map_rgb(255, 255, 255), true);
+	SetCachedText(data->left, "<");
+	data->right = CreateCachedText(game, data->font, al_map_rgb(255, 255, 255), true);
+	SetCachedText(data->right, ">");
+	data->shown = -1;
 	progress(game); // report that we progressed with the loading, so the engine can draw a progress bar
 
 	return data;
@@ -326,13 +368,18 @@ void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 void Gamestate_Unload(struct Game* game, struct GamestateResources* data) {
 	// Called when the gamestate library is being unloaded.
 	// Good place for freeing all allocated memory and resources.
-	al_destroy_font(data->font);
+	DestroyCachedText(data->label);
+	DestroyCachedText(data->framed);
+	DestroyCachedText(data->left);
+	DestroyCachedText(data->right);
+	ReleaseAsset(game, data->font);
 	free(data);
 }
 
 void Gamestate_Start(struct Game* game, struct GamestateResources* data) {
 	// Called when this gamestate gets control. Good place for initializing state,
 	// playing music etc.
+	IdleStart(game);
 	data->option = 0;
 	data->blink = 0;
 	data->offset = 30;
@@ -343,6 +390,7 @@ void Gamestate_Start(struct Game* game, struct GamestateResources* data) {
 
 void Gamestate_Stop(struct Game* game, struct GamestateResources* data) {
 	// Called when gamestate gets stopped. Stop timers, music etc. here.
+	IdleStop(game);
 }
 
 // Ignore those for now.
@@ -19,7 +19,12 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#include "../cache.h"
 #include "../common.h"
+#include "../idle.h"
+#include "../profiler.h"
+#include "../text.h"
+#include "../trace.h"
 #include <allegro5/allegro_primitives.h>
 #include <libsuperderpy.h>
 #include <math.h>
@@ -28,6 +33,7 @@ struct GamestateResources {
 	// This struct is for every resource allocated and used by your gamestate.
 	// It gets created on load and then gets passed around to all other function calls.
 	ALLEGRO_FONT* font;
+	struct CachedText* caption;
 	ALLEGRO_BITMAP* bitmap;
 	ALLEGRO_SAMPLE* sample;
 	ALLEGRO_SAMPLE_INSTANCE* boom;
@@ -42,10 +48,15 @@ void Gamestate_Logic(struct Game* game, struct GamestateResources* data, double
 void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
 	// Called as soon as possible, but no sooner than next Gamestate_Logic call.
 	// Draw everything to the screen here.
+	if (game->data->headless) {
+		return; // see EnableHeadless
+	}
+	PROFILE(game, "notfine", PROFILE_DRAW);
+	KeepFrame(game, INFINITY);
 
 	al_draw_bitmap(data->bitmap, 0, 0, 0);
 
-	DrawTextWithShadow(data->font, al_map_rgb(255, 255, 255), 320 / 2, 140, ALLEGRO_ALIGN_CENTER, "Computer is not fine! :(");
+	DrawCachedText(game, data->caption, 320 / 2, 140, ALLEGRO_ALIGN_CENTER);
 }
 
 void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data, ALLEGRO_EVENT* ev) {
@@ -56,13 +67,16 @@ void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data,
 void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 	// Called once, when the gamestate library is being loaded.
 	// Good place for allocating memory, loading bitmaps etc.
+	TRACE("load", "notfine");
 	struct GamestateResources* data = malloc(sizeof(struct GamestateResources));
-	data->font = al_create_builtin_font();
+	data->font = AcquireBuiltinFont(game);
+	data->caption = CreateCachedText(game, data->font, al_map_rgb(255, 255, 255), true);
+	SetCachedText(data->caption, "Computer is not fine! :(");
 	progress(game); // report that we progressed with the loading, so the engine can draw a progress bar
-	data->bitmap = al_load_bitmap(GetDataFilePath(game, "notfine.png"));
+	data->bitmap = AcquireBitmap(game, "notfine.png");
 	progress(game);
 
-	data->sample = al_load_sample(GetDataFilePath(game, "boom.flac"));
+	data->sample = AcquireSample(game, "boom.flac");
 	data->boom = al_create_sample_instance(data->sample);
 	al_attach_sample_instance_to_mixer(data->boom, game->audio.fx);
 	progress(game);
@@ -75,22 +89,25 @@ void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 void Gamestate_Unload(struct Game* game, struct GamestateResources* data) {
 	// Called when the gamestate library is being unloaded.
 	// Good place for freeing all allocated memory and resources.
-	al_destroy_font(data->font);
-	al_destroy_bitmap(data->bitmap);
+	DestroyCachedText(data->caption);
+	ReleaseAsset(game, data->font);
+	ReleaseAsset(game, data->bitmap);
 	al_destroy_sample_instance(data->boom);
-	al_destroy_sample(data->sample);
+	ReleaseAsset(game, data->sample);
 	free(data);
 }
 
 void Gamestate_Start(struct Game* game, struct GamestateResources* data) {
 	// Called when this gamestate gets control. Good place for initializing state,
 	// playing music etc.
+	IdleStart(game);
 	al_play_sample_instance(data->boom);
 	StartGamestate(game, "menu");
 }
 
 void Gamestate_Stop(struct Game* game, struct GamestateResources* data) {
 	// Called when gamestate gets stopped. Stop timers, music etc. here.
+	IdleStop(game);
 	StopGamestate(game, "menu");
 }
 
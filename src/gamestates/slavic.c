@@ -20,6 +20,10 @@
  */
 
 #include "../common.h"
+#include "../idle.h"
+#include "../preload.h"
+#include "../profiler.h"
+#include "../trace.h"
 #include <allegro5/allegro_primitives.h>
 #include <allegro5/allegro_ttf.h>
 #include <libsuperderpy.h>
@@ -28,6 +32,7 @@
 struct GamestateResources {
 	ALLEGRO_BITMAP* slavic;
 	struct Timeline* timeline;
+	double end; // of the timeline, in game->time
 	ALLEGRO_SAMPLE* sample;
 	ALLEGRO_SAMPLE_INSTANCE* sound;
 };
@@ -36,7 +41,7 @@ int Gamestate_ProgressCount = 1;
 
 //==================================Timeline manager actions BEGIN
 
-static TM_ACTION(End) {
+TRACED_ACTION(End) {
 	if (action->state == TM_ACTIONSTATE_RUNNING) {
 		UnloadAllGamestates(game);
 		StartGame(game, false);
@@ -47,20 +52,33 @@ static TM_ACTION(End) {
 //==================================Timeline manager actions END
 
 void Gamestate_Logic(struct Game* game, struct GamestateResources* data, double delta) {
-	TM_Process(data->timeline, delta);
+	PROFILE(game, "slavic", PROFILE_LOGIC);
+	delta = SimulationDelta(game, delta);
+	{
+		PROFILE(game, "slavic", PROFILE_TIMELINE);
+		TM_Process(data->timeline, delta);
+	}
 }
 
 void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
+	if (game->data->headless) {
+		return; // see EnableHeadless
+	}
+	PROFILE(game, "slavic", PROFILE_DRAW);
+	KeepFrame(game, data->end - game->time); // until the timeline ends
 	al_draw_bitmap(data->slavic, 0, 0, 0);
 }
 
 void Gamestate_Start(struct Game* game, struct GamestateResources* data) {
+	IdleStart(game);
+	data->end = game->time + 3;
 	TM_AddDelay(data->timeline, 3);
 	TM_AddAction(data->timeline, End, NULL);
 	al_play_sample_instance(data->sound);
 }
 
 void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data, ALLEGRO_EVENT* ev) {
+	PROFILE(game, "slavic", PROFILE_EVENTS);
 	if (((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_ESCAPE)) || (ev->type == ALLEGRO_EVENT_TOUCH_END)) {
 		UnloadAllGamestates(game);
 		StartGame(game, false);
@@ -68,14 +86,15 @@ void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data,
 }
 
 void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
+	TRACE("load", "slavic");
 	struct GamestateResources* data = malloc(sizeof(struct GamestateResources));
 	al_set_new_bitmap_flags(al_get_new_bitmap_flags() ^ ALLEGRO_MAG_LINEAR);
 
 	data->timeline = TM_Init(game, data, "main");
-	data->slavic = al_load_bitmap(GetDataFilePath(game, "slavic.png"));
+	data->slavic = LoadPreloadedBitmap(game, "slavic.png");
 	(*progress)(game);
 
-	data->sample = al_load_sample(GetDataFilePath(game, "slavic.flac"));
+	data->sample = LoadPreloadedSample(game, "slavic.flac");
 	data->sound = al_create_sample_instance(data->sample);
 	al_attach_sample_instance_to_mixer(data->sound, game->audio.music);
 
@@ -83,6 +102,7 @@ void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 }
 
 void Gamestate_Stop(struct Game* game, struct GamestateResources* data) {
+	IdleStop(game);
 }
 
 void Gamestate_Unload(struct Game* game, struct GamestateResources* data) {
@@ -19,7 +19,18 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#include "../atlas.h"
+#include "../cache.h"
 #include "../common.h"
+#include "../crowd.h"
+#include "../idle.h"
+#include "../loader.h"
+#include "../palette.h"
+#include "../postfx.h"
+#include "../profiler.h"
+#include "../progress.h"
+#include "../text.h"
+#include "../trace.h"
 #include <allegro5/allegro_primitives.h>
 #include <libsuperderpy.h>
 #include <math.h>
@@ -28,29 +39,47 @@ struct GamestateResources {
 	// This struct is for every resource allocated and used by your gamestate.
 	// It gets created on load and then gets passed around to all other function calls.
 	ALLEGRO_FONT* font;
-	struct Character *maks, *people[64], *person, *leftkey, *rightkey;
-	ALLEGRO_BITMAP *bg, *sits, *area, *meter, *marker, *pixelator, *audience;
+	struct CachedText *leftlabel, *rightlabel;
+	struct Character *maks, *person, *leftkey, *rightkey;
+	struct Crowd* crowd;
+	struct Atlas* atlas;
+	struct PalettedBitmap* bg;
+	struct PalettedBitmap* sits;
+	ALLEGRO_BITMAP *meter, *marker;
 	float offset, skew, level;
 	struct Timeline* timeline;
 	int meteroffset;
 	float zoom;
 	bool started;
+	double accumulator;
+	struct {
+		float offset, skew, zoom, meteroffset;
+	} previous; // state before the last step, for interpolated drawing
 	ALLEGRO_SAMPLE* sample;
 	ALLEGRO_SAMPLE_INSTANCE* chimpology;
 };
 
-const int MAKS = 64 - 16;
+#define AUDIENCE_ROWS 8
+#define AUDIENCE_COLS 8
 
-int Gamestate_ProgressCount = 101; // number of loading steps as reported by Gamestate_Load
+const int MAKS = AUDIENCE_COLS * (AUDIENCE_ROWS - 2);
 
-static TM_ACTION(Move) {
+int Gamestate_ProgressCount = PROGRESS_TICKS; // see progress.c
+
+// The simulation advances in fixed steps, no matter how often Gamestate_Logic
+// gets called, so that the difficulty curve and the score don't depend on the
+// frame rate. Drawing interpolates between the last two steps.
+#define STEP (1.0 / 60.0)
+#define MAX_STEPS 8 // per Gamestate_Logic call, so a long stall doesn't have to be caught up on
+
+TRACED_ACTION(Move) {
 	if (action->state == TM_ACTIONSTATE_RUNNING) {
 		data->offset += 0.09;
 	}
 	return false;
 }
 
-static TM_ACTION(Skew) {
+TRACED_ACTION(Skew) {
 	if (action->state == TM_ACTIONSTATE_START) {
 		data->started = true;
 	}
@@ -66,7 +95,7 @@ static TM_ACTION(Skew) {
 	return false;
 }
 
-static TM_ACTION(ZoomOut) {
+TRACED_ACTION(ZoomOut) {
 	if (action->state == TM_ACTIONSTATE_RUNNING) {
 		data->zoom += 0.01;
 		if (data->zoom >= 2) {
@@ -76,7 +105,7 @@ static TM_ACTION(ZoomOut) {
 	return false;
 }
 
-static TM_ACTION(ShowMeter) {
+TRACED_ACTION(ShowMeter) {
 	if (action->state == TM_ACTIONSTATE_START) {
 		data->skew = 0;
 	}
@@ -89,23 +118,23 @@ static TM_ACTION(ShowMeter) {
 	return false;
 }
 
-static TM_ACTION(ShowMaks) {
+TRACED_ACTION(ShowMaks) {
 	if (action->state == TM_ACTIONSTATE_RUNNING) {
 		SetCharacterPosition(game, data->maks, 16, 82, 0);
-		SetCharacterPosition(game, data->people[MAKS], -100, -100, 0);
+		SetCrowdMemberSprite(game, data->crowd, MAKS, -1);
 	}
 	return true;
 }
 
-static TM_ACTION(PrepMaks) {
+TRACED_ACTION(PrepMaks) {
 	if (action->state == TM_ACTIONSTATE_START) {
-		SelectSpritesheet(game, data->people[MAKS], "maks-prep");
-		MoveCharacter(game, data->people[MAKS], -2, -5, 0);
+		SetCrowdMemberSprite(game, data->crowd, MAKS, GetCrowdSprite(data->crowd, "maks-prep"));
+		MoveCrowdMember(game, data->crowd, MAKS, -2, -5);
 	}
 	return true;
 }
 
-static TM_ACTION(MovePrepingMaks) {
+TRACED_ACTION(MovePrepingMaks) {
 	int* pos;
 	if (action->state == TM_ACTIONSTATE_INIT) {
 		pos = malloc(sizeof(int));
@@ -118,9 +147,9 @@ static TM_ACTION(MovePrepingMaks) {
 		(*pos)++;
 		if (*pos == 10) {
 			*pos = 0;
-			MoveCharacter(game, data->people[MAKS], -3, 0, 0);
+			MoveCrowdMember(game, data->crowd, MAKS, -3, 0);
 
-			if (GetCharacterX(game, data->people[MAKS]) <= 5) {
+			if (data->crowd->x[MAKS] <= 5) {
 				return true;
 			}
 		}
@@ -131,10 +160,14 @@ static TM_ACTION(MovePrepingMaks) {
 	return false;
 }
 
-void Gamestate_Logic(struct Game* game, struct GamestateResources* data, double delta) {
-	// Called 60 times per second. Here you should do all your game logic.
-	AnimateCharacter(game, data->maks, delta, 1);
-	AnimateCharacter(game, data->person, delta, 1);
+static void Step(struct Game* game, struct GamestateResources* data) {
+	data->previous.offset = data->offset;
+	data->previous.skew = data->skew;
+	data->previous.zoom = data->zoom;
+	data->previous.meteroffset = data->meteroffset;
+
+	AnimateCharacter(game, data->maks, STEP, 1);
+	AnimateCharacter(game, data->person, STEP, 1);
 
 #ifdef ALLEGRO_ANDROID
 	SetCharacterPosition(game, data->leftkey, GetCharacterX(game, data->leftkey), 180 - data->meteroffset - 42, 0);
@@ -144,88 +177,94 @@ void Gamestate_Logic(struct Game* game, struct GamestateResources* data, double
 	SetCharacterPosition(game, data->rightkey, GetCharacterX(game, data->rightkey), data->meteroffset + 28, 0);
 #endif
 
-	TM_Process(data->timeline, delta);
+	{
+		PROFILE(game, "walk", PROFILE_TIMELINE);
+		TM_Process(data->timeline, STEP);
+	}
+}
 
-	if (fabsf(data->skew) >= 1) {
-		SwitchCurrentGamestate(game, "fall");
+void Gamestate_Logic(struct Game* game, struct GamestateResources* data, double delta) {
+	// Called with the time elapsed since the last call, which runs the simulation in fixed steps.
+	PROFILE(game, "walk", PROFILE_LOGIC);
+	data->accumulator += SimulationDelta(game, delta);
+	if (data->accumulator > STEP * MAX_STEPS) {
+		data->accumulator = STEP * MAX_STEPS;
 	}
+	while (data->accumulator >= STEP) {
+		data->accumulator -= STEP;
+		Step(game, data);
+		if (fabsf(data->skew) >= 1) {
+			ChangeCurrentGamestate(game, "fall");
+			break;
+		}
+	}
+}
+
+static float Interpolate(float previous, float current, float alpha) {
+	return previous + (current - previous) * alpha;
 }
 
 void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
 	// Called as soon as possible, but no sooner than next Gamestate_Logic call.
 	// Draw everything to the screen here.
+	if (game->data->headless) {
+		return; // see EnableHeadless
+	}
+	PROFILE(game, "walk", PROFILE_DRAW);
+	float alpha = data->accumulator / STEP;
+	float offset = Interpolate(data->previous.offset, data->offset, alpha);
+	float skew = Interpolate(data->previous.skew, data->skew, alpha);
+	float zoom = Interpolate(data->previous.zoom, data->zoom, alpha);
+	int meteroffset = roundf(Interpolate(data->previous.meteroffset, data->meteroffset, alpha));
 
-	al_set_target_bitmap(data->pixelator);
+	UpdateCrowdLayer(game, data->crowd);
 
-	al_set_target_bitmap(data->area);
+	ALLEGRO_BITMAP* area = AcquireRenderTarget(game, false);
+	al_set_target_bitmap(area);
 	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
-	DrawCharacter(game, data->person);
-
-	float spacing = 10, x = 117, y = 88;
-	int i = 0;
+	DrawCrowdCharacter(game, data->crowd, data->person);
+	al_draw_bitmap(data->crowd->layer, 0, 0, 0);
 
-	while (y < 180) {
-		for (int j = 0; j < 8; j++) {
-			DrawCharacter(game, data->people[i * 8 + j]);
-		}
-
-		al_draw_bitmap(data->sits, (int)x, (int)y, 0);
-		x -= spacing;
-		y += spacing;
-		spacing += 0.5;
-
-		i++;
-	}
-
-	al_set_target_bitmap(data->pixelator);
-	al_draw_scaled_bitmap(data->bg, 0, 0, 320, 180, -(int)data->offset, -(180 * (data->zoom - 1)) + (int)data->offset, 320 * data->zoom, 180 * data->zoom, 0);
+	BeginPixelated(game);
+	DrawPalettedBitmap(game, data->bg, al_map_rgb(255, 255, 255), 0, 0, 320, 180, -(int)offset, -(180 * (zoom - 1)) + (int)offset, 320 * zoom, 180 * zoom, 0);
 
 	DrawCharacter(game, data->maks);
 
-	al_draw_scaled_bitmap(data->area, 0, 0, 320, 180, -(int)data->offset, -(180 * (data->zoom - 1)) + (int)data->offset, 320 * data->zoom, 180 * data->zoom, 0);
+	DrawZoomed(area, al_map_rgb(255, 255, 255), -(int)offset, -(180 * (zoom - 1)) + (int)offset, zoom);
+	ReleaseRenderTarget(area);
 
-	al_draw_bitmap(data->meter, 11, 6 + data->meteroffset, 0);
-	al_draw_filled_rectangle(11 + 4, 6 + 7 + data->meteroffset, 309 - 4, 25 - 7 + data->meteroffset, al_map_rgb(0, 0, 0));
-	al_draw_bitmap(data->marker, (309 - 4 - (11 + 4)) / 2 + 11 + 4 - 5, 6 + 2 + data->meteroffset, 0);
+	al_draw_bitmap(data->meter, 11, 6 + meteroffset, 0);
+	al_draw_filled_rectangle(11 + 4, 6 + 7 + meteroffset, 309 - 4, 25 - 7 + meteroffset, al_map_rgb(0, 0, 0));
+	al_draw_bitmap(data->marker, (309 - 4 - (11 + 4)) / 2 + 11 + 4 - 5, 6 + 2 + meteroffset, 0);
 
-	al_draw_filled_rectangle((309 - 4 - (11 + 4)) / 2 + 11 + 4 + fmin(0, ((309 - 4 - (11 + 4)) / 2) * data->skew),
-		6 + 7 + 1 + data->meteroffset,
-		(309 - 4 - (11 + 4)) / 2 + 11 + 4 + fmax(0, ((309 - 4 - (11 + 4)) / 2) * data->skew),
-		25 - 7 - 1 + data->meteroffset,
+	al_draw_filled_rectangle((309 - 4 - (11 + 4)) / 2 + 11 + 4 + fmin(0, ((309 - 4 - (11 + 4)) / 2) * skew),
+		6 + 7 + 1 + meteroffset,
+		(309 - 4 - (11 + 4)) / 2 + 11 + 4 + fmax(0, ((309 - 4 - (11 + 4)) / 2) * skew),
+		25 - 7 - 1 + meteroffset,
 		al_map_rgb(255, 0, 0));
 
 	DrawCharacter(game, data->leftkey);
 	DrawCharacter(game, data->rightkey);
 
-	if (strcmp(data->leftkey->spritesheet->name, "ready") != 0) {
-		al_draw_text(data->font, al_map_rgb(0, 0, 0), GetCharacterX(game, data->leftkey) + 18, GetCharacterY(game, data->leftkey) + 15, ALLEGRO_ALIGN_LEFT, "<");
-		al_draw_text(data->font, al_map_rgb(0, 0, 0), GetCharacterX(game, data->leftkey) + 19, GetCharacterY(game, data->leftkey) + 15, ALLEGRO_ALIGN_LEFT, "-");
-	} else {
-		al_draw_text(data->font, al_map_rgb(0, 0, 0), GetCharacterX(game, data->leftkey) + 16, GetCharacterY(game, data->leftkey) + 13, ALLEGRO_ALIGN_LEFT, "<");
-		al_draw_text(data->font, al_map_rgb(0, 0, 0), GetCharacterX(game, data->leftkey) + 17, GetCharacterY(game, data->leftkey) + 13, ALLEGRO_ALIGN_LEFT, "-");
-	}
+	// pressed keys move their labels along
+	int left = strcmp(data->leftkey->spritesheet->name, "ready") != 0 ? 2 : 0;
+	int right = strcmp(data->rightkey->spritesheet->name, "ready") != 0 ? 2 : 0;
+	DrawCachedText(game, data->leftlabel, GetCharacterX(game, data->leftkey) + 16 + left, GetCharacterY(game, data->leftkey) + 13 + left, ALLEGRO_ALIGN_LEFT);
+	DrawCachedText(game, data->rightlabel, GetCharacterX(game, data->rightkey) + 16 + right, GetCharacterY(game, data->rightkey) + 13 + right, ALLEGRO_ALIGN_LEFT);
 
-	if (strcmp(data->rightkey->spritesheet->name, "ready") != 0) {
-		al_draw_text(data->font, al_map_rgb(0, 0, 0), GetCharacterX(game, data->rightkey) + 21, GetCharacterY(game, data->rightkey) + 15, ALLEGRO_ALIGN_LEFT, ">");
-		al_draw_text(data->font, al_map_rgb(0, 0, 0), GetCharacterX(game, data->rightkey) + 18, GetCharacterY(game, data->rightkey) + 15, ALLEGRO_ALIGN_LEFT, "-");
-	} else {
-		al_draw_text(data->font, al_map_rgb(0, 0, 0), GetCharacterX(game, data->rightkey) + 19, GetCharacterY(game, data->rightkey) + 13, ALLEGRO_ALIGN_LEFT, ">");
-		al_draw_text(data->font, al_map_rgb(0, 0, 0), GetCharacterX(game, data->rightkey) + 16, GetCharacterY(game, data->rightkey) + 13, ALLEGRO_ALIGN_LEFT, "-");
-	}
-
-	SetFramebufferAsTarget(game);
-	al_draw_bitmap(data->pixelator, 0, 0, 0);
+	EndPixelated(game);
 }
 
 void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data, ALLEGRO_EVENT* ev) {
 	// Called for each event in Allegro event queue.
 	// Here you can handle user input, expiring timers etc.
+	PROFILE(game, "walk", PROFILE_EVENTS);
 	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_ESCAPE)) {
-		SwitchCurrentGamestate(game, "logo"); // mark this gamestate to be stopped and unloaded
+		ChangeCurrentGamestate(game, "logo"); // stays loaded for a quick restart
 		// When there are no active gamestates, the engine will quit.
 	}
 	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_BACK)) {
-		SwitchCurrentGamestate(game, "logo"); // mark this gamestate to be stopped and unloaded
+		ChangeCurrentGamestate(game, "logo"); // stays loaded for a quick restart
 		// When there are no active gamestates, the engine will quit.
 	}
 	if (!data->started) return;
@@ -273,14 +312,20 @@ void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data,
 void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 	// Called once, when the gamestate library is being loaded.
 	// Good place for allocating memory, loading bitmaps etc.
+	TRACE("load", "walk");
 	struct GamestateResources* data = malloc(sizeof(struct GamestateResources));
-	data->font = al_create_builtin_font();
-	progress(game); // report that we progressed with the loading, so the engine can draw a progress bar
+	data->font = AcquireBuiltinFont(game);
+	data->leftlabel = CreateCachedText(game, data->font, al_map_rgb(0, 0, 0), false);
+	SetCachedTextParts(data->leftlabel, 2, (struct TextPart[]){{"<", 0, 0}, {"-", 1, 0}});
+	data->rightlabel = CreateCachedText(game, data->font, al_map_rgb(0, 0, 0), false);
+	SetCachedTextParts(data->rightlabel, 2, (struct TextPart[]){{">", 3, 0}, {"-", 0, 0}});
+	// With the atlas built, all the spritesheets and the seats are already on its
+	// page, so none of them needs to be loaded from its own file.
+	data->atlas = LoadAtlas(game, "atlas/walk/atlas.ini");
+
 	data->maks = CreateCharacter(game, "maks");
 	RegisterSpritesheet(game, data->maks, "walk");
-	LoadSpritesheets(game, data->maks, progress);
-
-	progress(game);
+	UseAtlasSpritesheets(data->atlas, data->maks);
 
 	data->person = CreateCharacter(game, "person");
 	char* sprites[] = {"dorota", "dos", "green", "jagoda", "jukio", "maciej", "dalton",
@@ -294,71 +339,104 @@ void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 	RegisterSpritesheet(game, data->person, "maks");
 	RegisterSpritesheet(game, data->person, "maks-prep");
 	RegisterSpritesheet(game, data->person, "kacpi");
-	LoadSpritesheets(game, data->person, progress);
-	progress(game);
+	int covered = UseAtlasSpritesheets(data->atlas, data->person);
 
-	for (int i = 0; i < 64; i++) {
-		data->people[i] = CreateCharacter(game, "person");
-		data->people[i]->spritesheets = data->person->spritesheets;
-		data->people[i]->data = malloc(sizeof(int));
-		*((int*)data->people[i]->data) = rand() % 5;
-		SelectSpritesheet(game, data->people[i], sprites[rand() % (sizeof(sprites) / sizeof(sprites[0]))]);
-		progress(game);
+	// Without the atlas, only the spritesheets that end up on the seats get loaded,
+	// the rest is left for SelectLazySpritesheet.
+	char* seated[AUDIENCE_ROWS * AUDIENCE_COLS];
+	for (int i = 0; i < AUDIENCE_ROWS * AUDIENCE_COLS; i++) {
+		seated[i] = sprites[rand() % (sizeof(sprites) / sizeof(sprites[0]))];
 	}
-	SelectSpritesheet(game, data->people[MAKS], "maks");
 
-	data->bg = al_load_bitmap(GetDataFilePath(game, "bg.png"));
-	data->sits = al_load_bitmap(GetDataFilePath(game, "sits.png"));
-	data->meter = al_load_bitmap(GetDataFilePath(game, "meter.png"));
-	data->marker = al_load_bitmap(GetDataFilePath(game, "marker.png"));
+	// LoadDecodedSpritesheets reports a step for each spritesheet it sets up, i.e. for
+	// the ones on the atlas and the seated ones. The other 11 steps are reported by
+	// the rest of this function, with two for each key.
+	int decoded = 0;
+	for (struct Spritesheet* spritesheet = data->person->spritesheets; spritesheet; spritesheet = spritesheet->next) {
+		bool used = spritesheet->bitmap || strcmp(spritesheet->name, "maks") == 0 ||
+			strcmp(spritesheet->name, "maks-prep") == 0 || strcmp(spritesheet->name, "kacpi") == 0;
+		for (int i = 0; !used && i < AUDIENCE_ROWS * AUDIENCE_COLS; i++) {
+			used = strcmp(spritesheet->name, seated[i]) == 0;
+		}
+		decoded += used;
+	}
+	progress = BeginProgress(game, "walk", progress, 11 + decoded);
+	progress(game); // report that we progressed with the loading, so the engine can draw a progress bar
 
-	int flags = al_get_new_bitmap_flags();
-	al_add_new_bitmap_flag(ALLEGRO_NO_PRESERVE_TEXTURE);
-	data->area = al_create_bitmap(640, 360);
-	data->pixelator = al_create_bitmap(320, 180);
-	al_set_new_bitmap_flags(flags);
+	// Decode all the images and sounds in parallel first; LoadSpritesheets then only sets up the frames.
+	struct Loader* loader = CreateLoader(game);
+	LoadSpritesheetsAsync(loader, data->maks);
+	for (int i = 0; i < AUDIENCE_ROWS * AUDIENCE_COLS; i++) {
+		LoadSpritesheetAsync(loader, data->person, seated[i]);
+	}
+	LoadSpritesheetAsync(loader, data->person, "maks");
+	LoadSpritesheetAsync(loader, data->person, "maks-prep");
+	LoadSpritesheetAsync(loader, data->person, "kacpi");
+
+	LoadBitmapAsync(loader, &data->meter, "meter.png");
+	LoadBitmapAsync(loader, &data->marker, "marker.png");
+	LoadSampleAsync(loader, &data->sample, "chimpology.flac");
+
+	// meanwhile, keep this thread busy too
+	data->bg = LoadPalettedBitmap(game, "bg.png");
+	// the seats are only needed for packing the crowd at runtime
+	data->sits = NULL;
+	if (covered < sizeof(sprites) / sizeof(sprites[0]) + 3 || !GetAtlasSprite(data->atlas, "sits")) {
+		data->sits = LoadPalettedBitmap(game, "sits.png");
+	}
+	FinishLoader(loader);
+
+	LoadSpritesheets(game, data->maks, progress);
+	progress(game);
 
+	LoadDecodedSpritesheets(game, data->person, progress);
 	progress(game);
 
-	data->leftkey = CreateCharacter(game, "key");
-	RegisterSpritesheet(game, data->leftkey, "ready");
-	RegisterSpritesheet(game, data->leftkey, "pressed");
-	LoadSpritesheets(game, data->leftkey, progress);
+	data->crowd = CreateCrowd(game, data->person, AUDIENCE_ROWS, AUDIENCE_COLS, 320, 180);
+	for (int i = 0; i < data->crowd->count; i++) {
+		data->crowd->sprite[i] = GetCrowdSprite(data->crowd, seated[i]);
+	}
 	progress(game);
 
-	data->rightkey = CreateCharacter(game, "key");
-	RegisterSpritesheet(game, data->rightkey, "ready");
-	RegisterSpritesheet(game, data->rightkey, "pressed");
-	LoadSpritesheets(game, data->rightkey, progress);
+	// both keys share their spritesheets with the one in catch
+	data->leftkey = AcquireCharacter(game, "key", (char*[]){"ready", "pressed", NULL}, progress);
+	progress(game);
+
+	data->rightkey = AcquireCharacter(game, "key", (char*[]){"ready", "pressed", NULL}, progress);
 	progress(game);
 
-	data->sample = al_load_sample(GetDataFilePath(game, "chimpology.flac"));
 	data->chimpology = al_create_sample_instance(data->sample);
 	al_attach_sample_instance_to_mixer(data->chimpology, game->audio.voice);
 
 	data->timeline = TM_Init(game, data, "timeline");
+	EndProgress(game);
 	return data;
 }
 
+void Gamestate_PostLoad(struct Game* game, struct GamestateResources* data) {
+	BuildCrowdAtlas(game, data->crowd, data->sits, data->atlas);
+}
+
 void Gamestate_Unload(struct Game* game, struct GamestateResources* data) {
 	// Called when the gamestate library is being unloaded.
 	// Good place for freeing all allocated memory and resources.
-	al_destroy_font(data->font);
+	DestroyCachedText(data->leftlabel);
+	DestroyCachedText(data->rightlabel);
+	ReleaseAsset(game, data->font);
 	DestroyCharacter(game, data->maks);
-	for (int i = 0; i < 64; i++) {
-		data->people[i]->spritesheets = NULL; // shared with data->person, so free only once
-		free(data->people[i]->data);
-		DestroyCharacter(game, data->people[i]);
-	}
+	DestroyCrowd(game, data->crowd);
 	DestroyCharacter(game, data->person);
-	DestroyCharacter(game, data->leftkey);
-	DestroyCharacter(game, data->rightkey);
-	al_destroy_bitmap(data->bg);
-	al_destroy_bitmap(data->sits);
-	al_destroy_bitmap(data->area);
+	ReleaseCharacter(game, data->leftkey);
+	ReleaseCharacter(game, data->rightkey);
+	if (data->atlas) {
+		DestroyAtlas(data->atlas); // after everything drawn from it
+	}
+	DestroyPalettedBitmap(data->bg);
+	if (data->sits) {
+		DestroyPalettedBitmap(data->sits);
+	}
 	al_destroy_bitmap(data->meter);
 	al_destroy_bitmap(data->marker);
-	al_destroy_bitmap(data->pixelator);
 	TM_Destroy(data->timeline);
 	al_destroy_sample_instance(data->chimpology);
 	al_destroy_sample(data->sample);
@@ -368,13 +446,14 @@ void Gamestate_Unload(struct Game* game, struct GamestateResources* data) {
 void Gamestate_Start(struct Game* game, struct GamestateResources* data) {
 	// Called when this gamestate gets control. Good place for initializing state,
 	// playing music etc.
+	IdleStart(game);
 	SelectSpritesheet(game, data->maks, "walk");
 	SetCharacterPosition(game, data->maks, -120, 80, 0);
 	SetCharacterPosition(game, data->leftkey, 9, -128, 0);
 	SetCharacterPosition(game, data->rightkey, 320 - 2 - 48, -128, 0);
 	SelectSpritesheet(game, data->leftkey, "ready");
 	SelectSpritesheet(game, data->rightkey, "ready");
-	SelectSpritesheet(game, data->person, "kacpi");
+	SelectLazySpritesheet(game, data->person, "kacpi");
 	SetCharacterPosition(game, data->person, 173, 3, 0);
 	data->offset = 0;
 	data->skew = 0;
@@ -383,6 +462,11 @@ void Gamestate_Start(struct Game* game, struct GamestateResources* data) {
 	data->zoom = 1;
 	data->started = false;
 	data->meteroffset = -100;
+	data->accumulator = 0;
+	data->previous.offset = data->offset;
+	data->previous.skew = data->skew;
+	data->previous.zoom = data->zoom;
+	data->previous.meteroffset = data->meteroffset;
 	al_play_sample_instance(data->chimpology);
 	TM_AddDelay(data->timeline, 2);
 	TM_AddQueuedBackgroundAction(data->timeline, ShowMeter, NULL, 2);
@@ -396,39 +480,24 @@ void Gamestate_Start(struct Game* game, struct GamestateResources* data) {
 
 	al_set_audio_stream_playing(game->data->music, true);
 
-	float spacing = 10, x = 117, y = 88;
-	int i = 0;
-
-	while (y < 180) {
-		for (int j = 0; j < 8; j++) {
-			SetCharacterPosition(game, data->people[i * 8 + j], x + 40 * j + 9 - *((int*)data->people[i * 8 + j]->data) + 2, y - 18, 0);
-		}
-
-		x -= spacing;
-		y += spacing;
-		spacing += 0.5;
-
-		i++;
-	}
+	ResetCrowd(game, data->crowd);
+	SetCrowdMemberSprite(game, data->crowd, MAKS, GetCrowdSprite(data->crowd, "maks"));
 }
 
 void Gamestate_Stop(struct Game* game, struct GamestateResources* data) {
 	// Called when gamestate gets stopped. Stop timers, music etc. here.
+	IdleStop(game);
 	game->data->score -= 366;
 	if (game->data->score < 0) {
 		game->data->score = 0;
 	}
 	al_stop_sample_instance(data->chimpology);
+	TM_CleanQueue(data->timeline);
+	TM_CleanBackgroundQueue(data->timeline);
 }
 
 // Ignore those for now.
 // TODO: Check, comment, refine and/or remove:
-void Gamestate_Reload(struct Game* game, struct GamestateResources* data) {
-	int flags = al_get_new_bitmap_flags();
-	al_add_new_bitmap_flag(ALLEGRO_NO_PRESERVE_TEXTURE);
-	data->area = al_create_bitmap(640, 360);
-	data->pixelator = al_create_bitmap(320, 180);
-	al_set_new_bitmap_flags(flags);
-}
+void Gamestate_Reload(struct Game* game, struct GamestateResources* data) {}
 void Gamestate_Pause(struct Game* game, struct GamestateResources* data) {}
 void Gamestate_Resume(struct Game* game, struct GamestateResources* data) {}
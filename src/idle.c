@@ -0,0 +1,124 @@
+/*! \file idle.c
+ *  \brief Throttling of frames on screens that don't change.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "idle.h"
+#include "common.h"
+#include <libsuperderpy.h>
+#include <math.h>
+
+// The engine draws and flips the display on every frame. Gamestates showing
+// a static screen call KeepFrame from Gamestate_Draw to tell for how long
+// their output stays the same unless some input arrives. When all the
+// running gamestates did so, the frame is held on screen: the next iteration
+// of the main loop, which starts after the display got flipped, waits until
+// either that time passes (at most MAX_IDLE, so that timers and timelines
+// still get a chance to run) or the player does something. The wait happens
+// on a queue of our own, so the engine still gets all the events afterwards.
+// Input that the engine already passed on before the wait cancels it, as
+// the gamestates may need to react to it.
+//
+// Every gamestate calls IdleStart and IdleStop from Gamestate_Start and
+// Gamestate_Stop, so that it's known how many of them have to keep their frame.
+
+#define MAX_IDLE 0.5
+
+static struct {
+	int running; // started gamestates
+	int declared;
+	double duration;
+	double until; // end of the wait before the next logic step, 0 when not idle
+	ALLEGRO_EVENT_QUEUE* queue;
+} idle;
+
+void IdleStart(struct Game* game) {
+	idle.running++;
+}
+
+void IdleStop(struct Game* game) {
+	idle.running--;
+}
+
+void KeepFrame(struct Game* game, double duration) {
+	idle.declared++;
+	idle.duration = fmin(idle.duration, duration);
+}
+
+void IdlePreDraw(struct Game* game) {
+	idle.declared = 0;
+	idle.duration = MAX_IDLE;
+}
+
+static void CreateQueue(struct Game* game) {
+	idle.queue = al_create_event_queue();
+	al_register_event_source(idle.queue, al_get_display_event_source(game->display));
+	if (al_is_keyboard_installed()) {
+		al_register_event_source(idle.queue, al_get_keyboard_event_source());
+	}
+	if (al_is_mouse_installed()) {
+		al_register_event_source(idle.queue, al_get_mouse_event_source());
+	}
+	if (al_is_touch_input_installed()) {
+		al_register_event_source(idle.queue, al_get_touch_input_event_source());
+	}
+}
+
+void IdlePostDraw(struct Game* game) {
+	idle.until = 0;
+	if (!idle.declared || idle.duration <= 0 || game->loading.inProgress) {
+		return;
+	}
+	// any gamestate that doesn't keep its frame keeps the game from idling
+	if (idle.declared < idle.running) {
+		return;
+	}
+	idle.until = al_get_time() + idle.duration;
+}
+
+void IdleEvent(struct Game* game, ALLEGRO_EVENT* event) {
+	// Anything but the engine's timer and its own events counts as input.
+	if (event->type != ALLEGRO_EVENT_TIMER && !ALLEGRO_EVENT_TYPE_IS_USER(event->type)) {
+		idle.until = 0;
+	}
+}
+
+void IdlePreLogic(struct Game* game) {
+	// The held frame is already on screen by now. Whatever is left in our queue
+	// has already been handled by the engine (see IdleEvent), so it's only
+	// cleared afterwards, for the next wait.
+	double timeout = idle.until - al_get_time();
+	if (idle.until && timeout > 0) {
+		if (!idle.queue) {
+			CreateQueue(game);
+		}
+		al_wait_for_event_timed(idle.queue, NULL, timeout);
+	}
+	idle.until = 0;
+	if (idle.queue) {
+		al_flush_event_queue(idle.queue);
+	}
+}
+
+void DestroyIdle(void) {
+	if (idle.queue) {
+		al_destroy_event_queue(idle.queue);
+	}
+	idle.queue = NULL;
+}
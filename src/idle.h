@@ -0,0 +1,11 @@
+#pragma once
+#include "common.h"
+
+void IdleStart(struct Game* game);
+void IdleStop(struct Game* game);
+void KeepFrame(struct Game* game, double duration);
+void IdleEvent(struct Game* game, ALLEGRO_EVENT* event);
+void IdlePreDraw(struct Game* game);
+void IdlePostDraw(struct Game* game);
+void IdlePreLogic(struct Game* game);
+void DestroyIdle(void);
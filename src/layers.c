@@ -0,0 +1,129 @@
+/*! \file layers.c
+ *  \brief Same-sized images packed into one texture, blended in a single pass.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "layers.h"
+#include "common.h"
+#include "preload.h"
+#include <allegro5/allegro_opengl.h>
+#include <libsuperderpy.h>
+
+// Crossfading two full-screen images the usual way means drawing both of
+// them, each one filling the whole screen. With both images in the same
+// texture, the crossfade shader samples the second one at a fixed offset
+// from the first and writes the blended pixel once, which gives exactly the
+// same result as the two draws with premultiplied alpha blending.
+//
+// Layers are laid out in a grid rather than in a single column to keep the
+// texture small enough for GPUs limited to 1024 or 2048 pixels. They're
+// separated by LAYER_PADDING transparent pixels, so linear filtering at the
+// edges doesn't bleed the neighbouring layer in.
+
+#define LAYER_COLUMNS 2
+#define LAYER_PADDING 2
+
+static void GetLayerPosition(struct LayeredBitmap* layers, int layer, float* x, float* y) {
+	*x = (layer % LAYER_COLUMNS) * (layers->width + LAYER_PADDING);
+	*y = (layer / LAYER_COLUMNS) * (layers->height + LAYER_PADDING);
+}
+
+struct LayeredBitmap* LoadLayeredBitmap(struct Game* game, const char* filenames[], int count) {
+	struct LayeredBitmap* layers = calloc(1, sizeof(struct LayeredBitmap));
+	layers->count = count;
+
+	ALLEGRO_BITMAP** bitmaps = calloc(count, sizeof(ALLEGRO_BITMAP*));
+	for (int i = 0; i < count; i++) {
+		bitmaps[i] = LoadPreloadedBitmap(game, filenames[i]);
+		if (al_get_bitmap_width(bitmaps[i]) > layers->width) {
+			layers->width = al_get_bitmap_width(bitmaps[i]);
+		}
+		if (al_get_bitmap_height(bitmaps[i]) > layers->height) {
+			layers->height = al_get_bitmap_height(bitmaps[i]);
+		}
+	}
+
+	int rows = (count + LAYER_COLUMNS - 1) / LAYER_COLUMNS;
+	layers->sheet = al_create_bitmap(LAYER_COLUMNS * (layers->width + LAYER_PADDING), rows * (layers->height + LAYER_PADDING));
+
+	ALLEGRO_BITMAP* target = al_get_target_bitmap();
+	al_set_target_bitmap(layers->sheet);
+	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+	for (int i = 0; i < count; i++) {
+		float x, y;
+		GetLayerPosition(layers, i, &x, &y);
+		al_draw_bitmap(bitmaps[i], x, y, 0);
+		al_destroy_bitmap(bitmaps[i]);
+	}
+	al_set_target_bitmap(target);
+
+	free(bitmaps);
+	return layers;
+}
+
+static void GetTextureSize(ALLEGRO_BITMAP* bitmap, int* width, int* height) {
+	// Textures may have been padded to a power of two, which texture
+	// coordinates are relative to.
+	*width = al_get_bitmap_width(bitmap);
+	*height = al_get_bitmap_height(bitmap);
+#ifdef ALLEGRO_CFG_OPENGL
+	al_get_opengl_texture_size(bitmap, width, height);
+#endif
+}
+
+void DrawCrossfade(struct Game* game, struct LayeredBitmap* layers, int from, int to, float fade, float x, float y) {
+	// Draws layer `to` over layer `from`, the latter faded out by `fade`.
+	float fx, fy, tx, ty;
+	GetLayerPosition(layers, from, &fx, &fy);
+	GetLayerPosition(layers, to, &tx, &ty);
+
+	if (!game->data->crossfade || !(al_get_bitmap_flags(layers->sheet) & ALLEGRO_VIDEO_BITMAP)) {
+		al_draw_tinted_bitmap_region(layers->sheet, al_map_rgba_f(1.0 - fade, 1.0 - fade, 1.0 - fade, 1.0 - fade),
+			fx, fy, layers->width, layers->height, x, y, 0);
+		al_draw_bitmap_region(layers->sheet, tx, ty, layers->width, layers->height, x, y, 0);
+		return;
+	}
+
+	// Shaders are GLSL-only, and Allegro keeps OpenGL textures upside down.
+	int width, height;
+	GetTextureSize(layers->sheet, &width, &height);
+	float offset[2] = {(tx - fx) / width, (fy - ty) / height};
+	al_use_shader(game->data->crossfade);
+	al_set_shader_float("fade", fade);
+	al_set_shader_float_vector("next_offset", 2, offset, 1);
+	al_draw_bitmap_region(layers->sheet, fx, fy, layers->width, layers->height, x, y, 0);
+	al_use_shader(NULL);
+}
+
+void DrawCharacterTwice(struct Game* game, struct Character* character) {
+	// Same as calling DrawCharacter twice in a row, in one pass.
+	if (!game->data->twice) {
+		DrawCharacter(game, character);
+		DrawCharacter(game, character);
+		return;
+	}
+	al_use_shader(game->data->twice);
+	DrawCharacter(game, character);
+	al_use_shader(NULL);
+}
+
+void DestroyLayeredBitmap(struct LayeredBitmap* layers) {
+	al_destroy_bitmap(layers->sheet);
+	free(layers);
+}
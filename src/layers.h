@@ -0,0 +1,13 @@
+#pragma once
+#include "common.h"
+
+struct LayeredBitmap {
+	ALLEGRO_BITMAP* sheet; // all the layers, in a grid of LAYER_COLUMNS
+	int count;
+	int width, height; // of a single layer
+};
+
+struct LayeredBitmap* LoadLayeredBitmap(struct Game* game, const char* filenames[], int count);
+void DrawCrossfade(struct Game* game, struct LayeredBitmap* layers, int from, int to, float fade, float x, float y);
+void DrawCharacterTwice(struct Game* game, struct Character* character);
+void DestroyLayeredBitmap(struct LayeredBitmap* layers);
@@ -0,0 +1,289 @@
+/*! \file loader.c
+ *  \brief Decoding of images and sounds on a pool of worker threads.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "loader.h"
+#include "common.h"
+#include "diskcache.h"
+#include "pack.h"
+#include "preload.h"
+#include "trace.h"
+#include <libsuperderpy.h>
+
+// Gamestate_Load runs on a single thread, so decoding PNG and FLAC files
+// there uses just one core. Files queued here get decoded by a pool of
+// worker threads instead. Bitmaps come out as memory bitmaps, which the
+// engine converts to video ones on the display thread once loading is done,
+// and sample instances are still created by the gamestate after
+// FinishLoader returns.
+
+#define MAX_WORKERS 8
+
+enum LoaderJobType {
+	LOADER_BITMAP,
+	LOADER_SAMPLE,
+	LOADER_SPRITESHEET,
+};
+
+struct LoaderJob {
+	enum LoaderJobType type;
+	char* path;
+	void* target;
+};
+
+struct Loader {
+	struct Game* game;
+	struct LoaderJob* jobs;
+	int count, size, next;
+	bool finished;
+
+	int bitmap_flags, bitmap_format;
+	const ALLEGRO_FILE_INTERFACE* file_interface;
+
+	ALLEGRO_THREAD* workers[MAX_WORKERS];
+	int workercount;
+	ALLEGRO_MUTEX* mutex;
+	ALLEGRO_COND* cond;
+};
+
+static void RunJob(struct Loader* loader, struct LoaderJob* job) {
+	TRACE("decode", job->path);
+	switch (job->type) {
+		case LOADER_BITMAP:
+			*(ALLEGRO_BITMAP**)job->target = LoadCachedBitmap(job->path);
+			break;
+		case LOADER_SAMPLE:
+			*(ALLEGRO_SAMPLE**)job->target = LoadCachedSample(job->path);
+			break;
+		case LOADER_SPRITESHEET: {
+			// LoadSpritesheets skips spritesheets that already have a bitmap,
+			// so it's only left with setting up the frames. The loading thread
+			// may be looking at the spritesheet while queueing more jobs, hence
+			// the lock.
+			struct Spritesheet* spritesheet = job->target;
+			ALLEGRO_BITMAP* bitmap = LoadCachedBitmap(job->path);
+			al_lock_mutex(loader->mutex);
+			if (bitmap) {
+				spritesheet->width = al_get_bitmap_width(bitmap) / spritesheet->cols;
+				spritesheet->height = al_get_bitmap_height(bitmap) / spritesheet->rows;
+			}
+			spritesheet->bitmap = bitmap;
+			al_unlock_mutex(loader->mutex);
+			break;
+		}
+	}
+}
+
+static void* Worker(ALLEGRO_THREAD* thread, void* arg) {
+	struct Loader* loader = arg;
+	// new bitmap flags and the file interface are per thread, so inherit them from the loading one
+	al_set_new_bitmap_flags(loader->bitmap_flags);
+	al_set_new_bitmap_format(loader->bitmap_format);
+	al_set_new_file_interface(loader->file_interface);
+
+	al_lock_mutex(loader->mutex);
+	while (true) {
+		if (loader->next < loader->count) {
+			struct LoaderJob job = loader->jobs[loader->next++];
+			al_unlock_mutex(loader->mutex);
+			RunJob(loader, &job);
+			al_lock_mutex(loader->mutex);
+		} else if (loader->finished) {
+			break;
+		} else {
+			al_wait_cond(loader->cond, loader->mutex);
+		}
+	}
+	al_unlock_mutex(loader->mutex);
+	return NULL;
+}
+
+struct Loader* CreateLoader(struct Game* game) {
+	struct Loader* loader = calloc(1, sizeof(struct Loader));
+	loader->game = game;
+	loader->bitmap_flags = al_get_new_bitmap_flags();
+	loader->bitmap_format = al_get_new_bitmap_format();
+	loader->file_interface = al_get_new_file_interface();
+	loader->mutex = al_create_mutex();
+	loader->cond = al_create_cond();
+
+	loader->workercount = al_get_cpu_count();
+	if (loader->workercount > MAX_WORKERS) {
+		loader->workercount = MAX_WORKERS;
+	}
+	if (loader->workercount < 1) {
+		loader->workercount = 1;
+	}
+	for (int i = 0; i < loader->workercount; i++) {
+		loader->workers[i] = al_create_thread(Worker, loader);
+		al_start_thread(loader->workers[i]);
+	}
+	return loader;
+}
+
+static void QueueJob(struct Loader* loader, enum LoaderJobType type, const char* filename, void* target) {
+	// Paths are resolved here, as the engine's data path lookup isn't meant to be used from other threads.
+	char* path = ResolveAsset(loader->game, filename);
+	al_lock_mutex(loader->mutex);
+	if (loader->count == loader->size) {
+		loader->size = loader->size ? loader->size * 2 : 16;
+		loader->jobs = realloc(loader->jobs, loader->size * sizeof(struct LoaderJob));
+	}
+	loader->jobs[loader->count++] = (struct LoaderJob){.type = type, .path = path, .target = target};
+	al_signal_cond(loader->cond);
+	al_unlock_mutex(loader->mutex);
+}
+
+void LoadBitmapAsync(struct Loader* loader, ALLEGRO_BITMAP** bitmap, const char* filename) {
+	*bitmap = TakePreloadedBitmap(loader->game, filename);
+	if (*bitmap) {
+		return;
+	}
+	QueueJob(loader, LOADER_BITMAP, filename, bitmap);
+}
+
+void LoadSampleAsync(struct Loader* loader, ALLEGRO_SAMPLE** sample, const char* filename) {
+	*sample = TakePreloadedSample(loader->game, filename);
+	if (*sample) {
+		return;
+	}
+	QueueJob(loader, LOADER_SAMPLE, filename, sample);
+}
+
+void LoadSpritesheetsAsync(struct Loader* loader, struct Character* character) {
+	// Call LoadSpritesheets on the character after FinishLoader.
+	for (struct Spritesheet* spritesheet = character->spritesheets; spritesheet; spritesheet = spritesheet->next) {
+		al_lock_mutex(loader->mutex);
+		bool loaded = spritesheet->bitmap;
+		al_unlock_mutex(loader->mutex);
+		if (loaded || !spritesheet->file) {
+			continue;
+		}
+		char filename[255];
+		snprintf(filename, 255, "sprites/%s/%s", character->name, spritesheet->file);
+		QueueJob(loader, LOADER_SPRITESHEET, filename, spritesheet);
+	}
+}
+
+void LoadSpritesheetAsync(struct Loader* loader, struct Character* character, const char* name) {
+	// Queues a single spritesheet, for characters that only get some of theirs
+	// loaded upfront. Call LoadDecodedSpritesheets after FinishLoader.
+	struct Spritesheet* spritesheet = character->spritesheets;
+	while (spritesheet && strcmp(spritesheet->name, name) != 0) {
+		spritesheet = spritesheet->next;
+	}
+	if (!spritesheet || !spritesheet->file) {
+		return;
+	}
+	// workers write the bitmap under the lock, see RunJob
+	al_lock_mutex(loader->mutex);
+	if (spritesheet->bitmap) {
+		al_unlock_mutex(loader->mutex);
+		return;
+	}
+	for (int i = 0; i < loader->count; i++) {
+		if (loader->jobs[i].target == spritesheet) {
+			al_unlock_mutex(loader->mutex);
+			return;
+		}
+	}
+	al_unlock_mutex(loader->mutex);
+	char filename[255];
+	snprintf(filename, 255, "sprites/%s/%s", character->name, spritesheet->file);
+	QueueJob(loader, LOADER_SPRITESHEET, filename, spritesheet);
+}
+
+static void LoadSomeSpritesheets(struct Game* game, struct Character* character, struct Spritesheet* extra, void (*progress)(struct Game*)) {
+	// LoadSpritesheets loads every spritesheet of the character that doesn't have
+	// a bitmap yet. To keep it from touching the ones that weren't asked for,
+	// they are unlinked from the list for the time of the call.
+	int count = 0;
+	for (struct Spritesheet* spritesheet = character->spritesheets; spritesheet; spritesheet = spritesheet->next) {
+		count++;
+	}
+	if (!count) {
+		return;
+	}
+	struct Spritesheet** order = malloc(count * sizeof(struct Spritesheet*));
+	int i = 0;
+	for (struct Spritesheet* spritesheet = character->spritesheets; spritesheet; spritesheet = spritesheet->next) {
+		order[i++] = spritesheet;
+	}
+
+	struct Spritesheet** tail = &character->spritesheets;
+	for (i = 0; i < count; i++) {
+		if (order[i]->bitmap || order[i] == extra) {
+			*tail = order[i];
+			tail = &order[i]->next;
+		}
+	}
+	*tail = NULL;
+
+	LoadSpritesheets(game, character, progress);
+
+	character->spritesheets = order[0];
+	for (i = 0; i < count; i++) {
+		order[i]->next = (i + 1 < count) ? order[i + 1] : NULL;
+	}
+	free(order);
+}
+
+void LoadDecodedSpritesheets(struct Game* game, struct Character* character, void (*progress)(struct Game*)) {
+	// Like LoadSpritesheets, but leaves the spritesheets that weren't decoded
+	// by the loader for SelectLazySpritesheet.
+	LoadSomeSpritesheets(game, character, NULL, progress);
+}
+
+void SelectLazySpritesheet(struct Game* game, struct Character* character, const char* name) {
+	// Loads the spritesheet first if that hasn't happened yet. That's done
+	// on the calling thread, so it's only meant as a fallback for the ones
+	// that weren't expected to be used.
+	for (struct Spritesheet* spritesheet = character->spritesheets; spritesheet; spritesheet = spritesheet->next) {
+		if (strcmp(spritesheet->name, name) == 0) {
+			if (!spritesheet->bitmap) {
+				PrintConsole(game, "Loading spritesheet %s of %s on first use.", name, character->name);
+				LoadSomeSpritesheets(game, character, spritesheet, NULL);
+			}
+			break;
+		}
+	}
+	SelectSpritesheet(game, character, (char*)name);
+}
+
+void FinishLoader(struct Loader* loader) {
+	// Waits until everything queued is decoded and frees the loader.
+	al_lock_mutex(loader->mutex);
+	loader->finished = true;
+	al_broadcast_cond(loader->cond);
+	al_unlock_mutex(loader->mutex);
+
+	for (int i = 0; i < loader->workercount; i++) {
+		al_join_thread(loader->workers[i], NULL);
+		al_destroy_thread(loader->workers[i]);
+	}
+
+	for (int i = 0; i < loader->count; i++) {
+		free(loader->jobs[i].path);
+	}
+	free(loader->jobs);
+	al_destroy_cond(loader->cond);
+	al_destroy_mutex(loader->mutex);
+	free(loader);
+}
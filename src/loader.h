@@ -0,0 +1,13 @@
+#pragma once
+#include "common.h"
+
+struct Loader;
+
+struct Loader* CreateLoader(struct Game* game);
+void LoadBitmapAsync(struct Loader* loader, ALLEGRO_BITMAP** bitmap, const char* filename);
+void LoadSampleAsync(struct Loader* loader, ALLEGRO_SAMPLE** sample, const char* filename);
+void LoadSpritesheetsAsync(struct Loader* loader, struct Character* character);
+void LoadSpritesheetAsync(struct Loader* loader, struct Character* character, const char* name);
+void LoadDecodedSpritesheets(struct Game* game, struct Character* character, void (*progress)(struct Game*));
+void SelectLazySpritesheet(struct Game* game, struct Character* character, const char* name);
+void FinishLoader(struct Loader* loader);
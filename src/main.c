@@ -20,6 +20,9 @@
 
 #include "common.h"
 #include "defines.h"
+#include "preload.h"
+#include "replay.h"
+#include "trace.h"
 #include <libsuperderpy.h>
 #include <signal.h>
 #include <stdio.h>
@@ -32,7 +35,7 @@ static _Noreturn void derp(int sig) {
 int main(int argc, char** argv) {
 	signal(SIGSEGV, derp);
 
-	srand(time(NULL));
+	srand(StartReplay(argc, argv)); // --record/--replay <file>, see replay.c
 
 	al_set_org_name("dosowisko.net");
 	al_set_app_name(LIBSUPERDERPY_GAMENAME_PRETTY);
@@ -44,15 +47,26 @@ int main(int argc, char** argv) {
 			.handlers = (struct Handlers){
 				.event = GlobalEventHandler,
 				.destroy = DestroyGameData,
+				.prelogic = GlobalPreLogic,
+				.postlogic = GlobalPostLogic,
+				.predraw = GlobalPreDraw,
+				.postdraw = GlobalPostDraw,
 			},
 		});
 	if (!game) { return 1; }
+	StartTrace(argc, argv); // --trace <file>, see trace.c
 
 	LoadGamestate(game, "dosowisko");
 	LoadGamestate(game, "slavic");
 	StartGamestate(game, "dosowisko");
 
 	game->data = CreateGameData(game);
+	PreloadGame(game); // while the splash screens play
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--headless") == 0) {
+			EnableHeadless(game);
+		}
+	}
 
 	al_hide_mouse_cursor(game->display);
 
@@ -0,0 +1,81 @@
+/*! \file mapping.c
+ *  \brief Read-only memory mapped files.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "mapping.h"
+#include <stdio.h>
+#include <stdlib.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Only takes real filesystem paths, not ones going through Allegro's file interfaces.
+
+bool MapFile(const char* path, struct Mapping* mapping) {
+#ifndef _WIN32
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return false;
+	}
+	void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return false;
+	}
+	mapping->data = data;
+	mapping->size = st.st_size;
+	return true;
+#else
+	// no mmap, read the whole file instead
+	FILE* file = fopen(path, "rb");
+	if (!file) {
+		return false;
+	}
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	unsigned char* data = size > 0 ? malloc(size) : NULL;
+	if (!data || fread(data, 1, size, file) != (size_t)size) {
+		free(data);
+		fclose(file);
+		return false;
+	}
+	fclose(file);
+	mapping->data = data;
+	mapping->size = size;
+	return true;
+#endif
+}
+
+void UnmapFile(struct Mapping* mapping) {
+#ifndef _WIN32
+	munmap((void*)mapping->data, mapping->size);
+#else
+	free((void*)mapping->data);
+#endif
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+
+struct Mapping {
+	const unsigned char* data;
+	size_t size;
+};
+
+bool MapFile(const char* path, struct Mapping* mapping);
+void UnmapFile(struct Mapping* mapping);
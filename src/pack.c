@@ -0,0 +1,191 @@
+/*! \file pack.c
+ *  \brief Assets read from a single memory mapped archive.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "pack.h"
+#include "common.h"
+#include "mapping.h"
+#include <allegro5/allegro_memfile.h>
+#include <allegro5/allegro_ttf.h>
+#include <libsuperderpy.h>
+
+// tools/datapack.c puts the game's images, sounds and fonts into data.pack
+// at build time. It's mapped once on startup, and assets found in its index
+// are read straight out of the mapping through memfiles instead of being
+// looked up and opened one by one. Anything not in the pack is read from
+// its own file as before.
+//
+// Paths handed out by ResolveAsset are either real paths or PACK_PREFIX
+// followed by the name in the pack. The pack never changes once opened,
+// so those can be used from any thread.
+
+#define PACK_PREFIX "pack:"
+
+struct PackEntry {
+	char* name;
+	uint32_t offset, size;
+};
+
+static struct {
+	struct Mapping mapping;
+	struct PackEntry* entries;
+	int count;
+} pack;
+
+static uint32_t Get32(const unsigned char* data) {
+	return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+void OpenPack(struct Game* game) {
+	char* path = FindDataFilePath(game, "data.pack");
+	if (!path) {
+		return;
+	}
+	bool mapped = MapFile(path, &pack.mapping);
+	free(path);
+	if (!mapped) {
+		return;
+	}
+
+	const unsigned char *data = pack.mapping.data, *end = data + pack.mapping.size;
+	if (pack.mapping.size < 8 || memcmp(data, "CPAK", 4) != 0) {
+		PrintConsole(game, "Invalid data pack, ignoring.");
+		UnmapFile(&pack.mapping);
+		return;
+	}
+	int count = Get32(data + 4);
+	pack.entries = calloc(count, sizeof(struct PackEntry));
+	data += 8;
+	for (int i = 0; i < count; i++) {
+		int length = data + 2 <= end ? data[0] | (data[1] << 8) : 0;
+		if (!length || data + 2 + length + 8 > end) {
+			PrintConsole(game, "Invalid data pack, ignoring.");
+			ClosePack();
+			return;
+		}
+		struct PackEntry* entry = &pack.entries[pack.count++];
+		entry->name = calloc(length + 1, 1);
+		memcpy(entry->name, data + 2, length);
+		entry->offset = Get32(data + 2 + length);
+		entry->size = Get32(data + 2 + length + 4);
+		data += 2 + length + 8;
+		if ((size_t)entry->offset + entry->size > pack.mapping.size) {
+			PrintConsole(game, "Invalid data pack, ignoring.");
+			ClosePack();
+			return;
+		}
+	}
+	PrintConsole(game, "Using data pack with %d files.", pack.count);
+}
+
+void ClosePack(void) {
+	for (int i = 0; i < pack.count; i++) {
+		free(pack.entries[i].name);
+	}
+	free(pack.entries);
+	if (pack.mapping.data) {
+		UnmapFile(&pack.mapping);
+	}
+	memset(&pack, 0, sizeof(pack));
+}
+
+static int CompareEntry(const void* key, const void* entry) {
+	return strcmp(key, ((const struct PackEntry*)entry)->name);
+}
+
+static struct PackEntry* FindEntry(const char* name) {
+	// entries are sorted by name by tools/datapack.c
+	if (!pack.count) {
+		return NULL;
+	}
+	return bsearch(name, pack.entries, pack.count, sizeof(struct PackEntry), CompareEntry);
+}
+
+char* ResolveAsset(struct Game* game, const char* filename) {
+	// Returns a newly allocated path to pass to the functions below.
+	if (FindEntry(filename)) {
+		char* path = malloc(strlen(PACK_PREFIX) + strlen(filename) + 1);
+		strcpy(path, PACK_PREFIX);
+		strcat(path, filename);
+		return path;
+	}
+	return strdup(GetDataFilePath(game, filename));
+}
+
+ALLEGRO_FILE* OpenAsset(const char* path) {
+	if (strncmp(path, PACK_PREFIX, strlen(PACK_PREFIX)) == 0) {
+		struct PackEntry* entry = FindEntry(path + strlen(PACK_PREFIX));
+		if (!entry) {
+			return NULL;
+		}
+		return al_open_memfile((void*)(pack.mapping.data + entry->offset), entry->size, "r");
+	}
+	return al_fopen(path, "rb");
+}
+
+ALLEGRO_BITMAP* LoadAssetBitmap(const char* path) {
+	ALLEGRO_FILE* file = OpenAsset(path);
+	if (!file) {
+		return NULL;
+	}
+	ALLEGRO_BITMAP* bitmap = al_load_bitmap_f(file, strrchr(path, '.'));
+	al_fclose(file);
+	return bitmap;
+}
+
+ALLEGRO_SAMPLE* LoadAssetSample(const char* path) {
+	ALLEGRO_FILE* file = OpenAsset(path);
+	if (!file) {
+		return NULL;
+	}
+	ALLEGRO_SAMPLE* sample = al_load_sample_f(file, strrchr(path, '.'));
+	al_fclose(file);
+	return sample;
+}
+
+ALLEGRO_AUDIO_STREAM* LoadAssetStream(struct Game* game, const char* filename, size_t buffers, unsigned int samples) {
+	char* path = ResolveAsset(game, filename);
+	ALLEGRO_FILE* file = OpenAsset(path);
+	free(path);
+	if (!file) {
+		return NULL;
+	}
+	// the stream keeps reading from the file and closes it when destroyed
+	ALLEGRO_AUDIO_STREAM* stream = al_load_audio_stream_f(file, strrchr(filename, '.'), buffers, samples);
+	if (!stream) {
+		al_fclose(file);
+	}
+	return stream;
+}
+
+ALLEGRO_FONT* LoadAssetFont(struct Game* game, const char* filename, int size, int flags) {
+	char* path = ResolveAsset(game, filename);
+	ALLEGRO_FILE* file = OpenAsset(path);
+	free(path);
+	if (!file) {
+		return NULL;
+	}
+	// the font keeps reading from the file and closes it when destroyed
+	ALLEGRO_FONT* font = al_load_ttf_font_f(file, filename, size, flags);
+	if (!font) {
+		al_fclose(file);
+	}
+	return font;
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include "common.h"
+
+void OpenPack(struct Game* game);
+void ClosePack(void);
+char* ResolveAsset(struct Game* game, const char* filename);
+ALLEGRO_FILE* OpenAsset(const char* path);
+ALLEGRO_BITMAP* LoadAssetBitmap(const char* path);
+ALLEGRO_SAMPLE* LoadAssetSample(const char* path);
+ALLEGRO_AUDIO_STREAM* LoadAssetStream(struct Game* game, const char* filename, size_t buffers, unsigned int samples);
+ALLEGRO_FONT* LoadAssetFont(struct Game* game, const char* filename, int size, int flags);
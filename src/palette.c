@@ -0,0 +1,173 @@
+/*! \file palette.c
+ *  \brief Palette-indexed bitmaps, expanded to colours by a shader while drawing.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "palette.h"
+#include "common.h"
+#include "preload.h"
+#include "restore.h"
+#include <libsuperderpy.h>
+
+// Indexed images take a quarter of the memory of RGBA ones and are uploaded
+// that much faster. They're produced at build time by tools/palpack.c from
+// the PNG files, which are still used when the indexed version is missing
+// or the platform can't run the palette shader.
+
+static bool Upload(struct PalettedBitmap* bitmap) {
+	ALLEGRO_LOCKED_REGION* region = al_lock_bitmap(bitmap->bitmap, ALLEGRO_PIXEL_FORMAT_SINGLE_CHANNEL_8, ALLEGRO_LOCK_WRITEONLY);
+	if (!region) {
+		return false;
+	}
+	for (int y = 0; y < bitmap->height; y++) {
+		memcpy((unsigned char*)region->data + y * region->pitch, bitmap->indices + y * bitmap->width, bitmap->width);
+	}
+	al_unlock_bitmap(bitmap->bitmap);
+
+	region = al_lock_bitmap(bitmap->palette, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_WRITEONLY);
+	if (!region) {
+		return false;
+	}
+	memcpy(region->data, bitmap->colors, 256 * 4);
+	al_unlock_bitmap(bitmap->palette);
+	return true;
+}
+
+static void Restore(struct Game* game, void* bitmap) {
+	Upload(bitmap);
+}
+
+static struct PalettedBitmap* LoadIndexed(struct Game* game, const char* filename) {
+	char name[255];
+	snprintf(name, 255, "paletted/%s", filename);
+	char* ext = strrchr(name, '.');
+	if (ext) {
+		*ext = 0;
+	}
+	strncat(name, ".pal", 254 - strlen(name));
+
+	char* path = FindDataFilePath(game, name);
+	if (!path) {
+		return NULL;
+	}
+	ALLEGRO_FILE* file = al_fopen(path, "rb");
+	free(path);
+	if (!file) {
+		return NULL;
+	}
+
+	char magic[4];
+	if (al_fread(file, magic, 4) != 4 || memcmp(magic, "CPAL", 4) != 0) {
+		PrintConsole(game, "Invalid paletted bitmap: %s", name);
+		al_fclose(file);
+		return NULL;
+	}
+	int width = (uint16_t)al_fread16le(file), height = (uint16_t)al_fread16le(file), colors = (uint16_t)al_fread16le(file);
+	unsigned char* palette = calloc(256, 4);
+	unsigned char* indices = malloc(width * height);
+	if (colors > 256 || al_fread(file, palette, colors * 4) != (size_t)colors * 4 ||
+		al_fread(file, indices, width * height) != (size_t)width * height) {
+		PrintConsole(game, "Invalid paletted bitmap: %s", name);
+		al_fclose(file);
+		free(palette);
+		free(indices);
+		return NULL;
+	}
+	al_fclose(file);
+
+	// Interpolating between indices makes no sense, so no filtering. The
+	// indices and colours are kept around, so the textures don't need to be
+	// preserved.
+	int flags = al_get_new_bitmap_flags(), format = al_get_new_bitmap_format();
+	al_set_new_bitmap_flags((flags & ~(ALLEGRO_MIN_LINEAR | ALLEGRO_MAG_LINEAR | ALLEGRO_MIPMAP)) | ALLEGRO_NO_PRESERVE_TEXTURE);
+
+	struct PalettedBitmap* bitmap = calloc(1, sizeof(struct PalettedBitmap));
+	bitmap->width = width;
+	bitmap->height = height;
+	bitmap->indices = indices;
+	bitmap->colors = palette;
+	al_set_new_bitmap_format(ALLEGRO_PIXEL_FORMAT_SINGLE_CHANNEL_8);
+	bitmap->bitmap = al_create_bitmap(width, height);
+	al_set_new_bitmap_format(ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE);
+	bitmap->palette = al_create_bitmap(256, 1);
+
+	al_set_new_bitmap_flags(flags);
+	al_set_new_bitmap_format(format);
+
+	if (!bitmap->bitmap || !bitmap->palette || !Upload(bitmap)) {
+		PrintConsole(game, "Could not create indexed texture for %s", name);
+		DestroyPalettedBitmap(bitmap);
+		return NULL;
+	}
+	TrackResource(bitmap, Restore);
+	return bitmap;
+}
+
+struct PalettedBitmap* LoadPalettedBitmap(struct Game* game, const char* filename) {
+	if (game->data->palette) {
+		struct PalettedBitmap* bitmap = LoadIndexed(game, filename);
+		if (bitmap) {
+			return bitmap;
+		}
+	}
+
+	struct PalettedBitmap* bitmap = calloc(1, sizeof(struct PalettedBitmap));
+	bitmap->bitmap = LoadPreloadedBitmap(game, filename);
+	bitmap->width = al_get_bitmap_width(bitmap->bitmap);
+	bitmap->height = al_get_bitmap_height(bitmap->bitmap);
+	return bitmap;
+}
+
+bool UsePalette(struct Game* game, struct PalettedBitmap* bitmap, bool twice) {
+	// Sets up the palette shader for drawing the bitmap, or sub-bitmaps of it,
+	// until al_use_shader(NULL). With twice, every pixel gets blended over itself
+	// like with DrawCharacterTwice. Returns false when the bitmap isn't paletted
+	// and can be drawn as it is.
+	if (!bitmap->palette) {
+		return false;
+	}
+	al_use_shader(game->data->palette);
+	al_set_shader_sampler("palette", bitmap->palette, 1);
+	al_set_shader_bool("twice", twice);
+	return true;
+}
+
+void DrawPalettedBitmap(struct Game* game, struct PalettedBitmap* bitmap, ALLEGRO_COLOR tint,
+	float sx, float sy, float sw, float sh, float dx, float dy, float dw, float dh, int flags) {
+	bool paletted = UsePalette(game, bitmap, false);
+	al_draw_tinted_scaled_bitmap(bitmap->bitmap, tint, sx, sy, sw, sh, dx, dy, dw, dh, flags);
+	if (paletted) {
+		al_use_shader(NULL);
+	}
+}
+
+void DestroyPalettedBitmap(struct PalettedBitmap* bitmap) {
+	if (bitmap->indices) {
+		UntrackResource(bitmap);
+	}
+	if (bitmap->bitmap) {
+		al_destroy_bitmap(bitmap->bitmap);
+	}
+	if (bitmap->palette) {
+		al_destroy_bitmap(bitmap->palette);
+	}
+	free(bitmap->indices);
+	free(bitmap->colors);
+	free(bitmap);
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include "common.h"
+
+struct PalettedBitmap {
+	ALLEGRO_BITMAP* bitmap; // palette indices, or the plain RGBA image when palette is NULL
+	ALLEGRO_BITMAP* palette; // 256x1
+	int width, height;
+	unsigned char *indices, *colors; // for restoring the textures, NULL when not paletted
+};
+
+struct PalettedBitmap* LoadPalettedBitmap(struct Game* game, const char* filename);
+bool UsePalette(struct Game* game, struct PalettedBitmap* bitmap, bool twice);
+void DrawPalettedBitmap(struct Game* game, struct PalettedBitmap* bitmap, ALLEGRO_COLOR tint,
+	float sx, float sy, float sw, float sh, float dx, float dy, float dw, float dh, int flags);
+void DestroyPalettedBitmap(struct PalettedBitmap* bitmap);
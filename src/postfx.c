@@ -0,0 +1,180 @@
+/*! \file postfx.c
+ *  \brief Shared offscreen targets and passes for drawing at the game's resolution.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "postfx.h"
+#include "common.h"
+#include <allegro5/allegro_primitives.h>
+#include <libsuperderpy.h>
+
+// Scenes that composite layers before putting them on screen borrow
+// viewport-sized targets from a pool for the duration of a single Draw,
+// instead of each owning a set of them. Their contents never outlive the
+// frame, so they don't need to be preserved when the GPU context gets lost.
+//
+// BeginPixelated makes whatever gets drawn until EndPixelated end up on
+// screen at exactly the game's resolution. When the framebuffer already is
+// that size, it's drawn to directly; only otherwise it goes through a pooled
+// target that gets scaled up at the end.
+//
+// Overlays are patterns generated by a shader over the whole viewport, which
+// gets the pixel coordinates as texture coordinates. Without shaders, the
+// pattern gets filled into a bitmap once instead, a row at a time.
+
+#define MAX_TARGETS 4
+
+static struct {
+	struct {
+		ALLEGRO_BITMAP* bitmap;
+		bool nearest, used;
+	} targets[MAX_TARGETS];
+	ALLEGRO_BITMAP* stage; // while pixelated through a target
+	ALLEGRO_BITMAP* checkerboard; // only without shaders
+} postfx;
+
+ALLEGRO_BITMAP* AcquireRenderTarget(struct Game* game, bool nearest) {
+	// Must be returned with ReleaseRenderTarget before the end of the frame.
+	int empty = -1;
+	for (int i = 0; i < MAX_TARGETS; i++) {
+		if (postfx.targets[i].bitmap && !postfx.targets[i].used && postfx.targets[i].nearest == nearest) {
+			postfx.targets[i].used = true;
+			return postfx.targets[i].bitmap;
+		}
+		if (!postfx.targets[i].bitmap && empty < 0) {
+			empty = i;
+		}
+	}
+	if (empty < 0) {
+		PrintConsole(game, "Render target pool exhausted!");
+		return NULL;
+	}
+
+	int flags = al_get_new_bitmap_flags();
+	al_add_new_bitmap_flag(ALLEGRO_NO_PRESERVE_TEXTURE);
+	if (nearest) {
+		al_set_new_bitmap_flags(al_get_new_bitmap_flags() & ~(ALLEGRO_MIN_LINEAR | ALLEGRO_MAG_LINEAR));
+	}
+	postfx.targets[empty].bitmap = al_create_bitmap(game->viewport.width, game->viewport.height);
+	al_set_new_bitmap_flags(flags);
+
+	postfx.targets[empty].nearest = nearest;
+	postfx.targets[empty].used = true;
+	return postfx.targets[empty].bitmap;
+}
+
+void ReleaseRenderTarget(ALLEGRO_BITMAP* target) {
+	for (int i = 0; i < MAX_TARGETS; i++) {
+		if (postfx.targets[i].bitmap == target) {
+			postfx.targets[i].used = false;
+		}
+	}
+}
+
+void BeginPixelated(struct Game* game) {
+	SetFramebufferAsTarget(game);
+	ALLEGRO_BITMAP* framebuffer = al_get_target_bitmap();
+	if (al_get_bitmap_width(framebuffer) == game->viewport.width && al_get_bitmap_height(framebuffer) == game->viewport.height) {
+		postfx.stage = NULL;
+		return;
+	}
+	postfx.stage = AcquireRenderTarget(game, true);
+	al_set_target_bitmap(postfx.stage);
+}
+
+void EndPixelated(struct Game* game) {
+	SetFramebufferAsTarget(game);
+	if (!postfx.stage) {
+		return;
+	}
+	al_draw_scaled_bitmap(postfx.stage, 0, 0, al_get_bitmap_width(postfx.stage), al_get_bitmap_height(postfx.stage),
+		0, 0, game->viewport.width, game->viewport.height, 0);
+	ReleaseRenderTarget(postfx.stage);
+	postfx.stage = NULL;
+}
+
+void DrawZoomed(ALLEGRO_BITMAP* source, ALLEGRO_COLOR tint, float x, float y, float scale) {
+	int w = al_get_bitmap_width(source), h = al_get_bitmap_height(source);
+	al_draw_tinted_scaled_bitmap(source, tint, 0, 0, w, h, x, y, w * scale, h * scale, 0);
+}
+
+void DrawOverlay(struct Game* game, ALLEGRO_SHADER* shader, ALLEGRO_COLOR color) {
+	float w = game->viewport.width, h = game->viewport.height;
+	ALLEGRO_VERTEX vertices[4] = {
+		{.x = 0, .y = 0, .u = 0, .v = 0, .color = color},
+		{.x = w, .y = 0, .u = w, .v = 0, .color = color},
+		{.x = 0, .y = h, .u = 0, .v = h, .color = color},
+		{.x = w, .y = h, .u = w, .v = h, .color = color},
+	};
+	al_use_shader(shader);
+	al_draw_prim(vertices, NULL, NULL, 0, 4, ALLEGRO_PRIM_TRIANGLE_STRIP);
+	al_use_shader(NULL);
+}
+
+static ALLEGRO_BITMAP* CreateCheckerboard(struct Game* game) {
+	int width = game->viewport.width, height = game->viewport.height;
+	ALLEGRO_BITMAP* bitmap = al_create_bitmap(width, height);
+	ALLEGRO_LOCKED_REGION* region = al_lock_bitmap(bitmap, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_WRITEONLY);
+	if (!region) {
+		al_destroy_bitmap(bitmap);
+		return NULL;
+	}
+	unsigned char* row = calloc(width, 4);
+	for (int x = 0; x < width; x += 2) {
+		row[x * 4 + 3] = 64; // premultiplied black
+	}
+	for (int y = 0; y < height; y++) {
+		unsigned char* line = (unsigned char*)region->data + y * region->pitch;
+		if (y % 2) {
+			memset(line, 0, width * 4);
+		} else {
+			memcpy(line, row, width * 4);
+		}
+	}
+	free(row);
+	al_unlock_bitmap(bitmap);
+	return bitmap;
+}
+
+void DrawCheckerboard(struct Game* game) {
+	// Darkens every other pixel of every other row, like an old CRT would.
+	if (game->data->checkerboard) {
+		DrawOverlay(game, game->data->checkerboard, al_map_rgba(0, 0, 0, 64));
+		return;
+	}
+	if (!postfx.checkerboard) {
+		postfx.checkerboard = CreateCheckerboard(game);
+		if (!postfx.checkerboard) {
+			return;
+		}
+	}
+	al_draw_bitmap(postfx.checkerboard, 0, 0, 0);
+}
+
+void DestroyRenderTargets(void) {
+	for (int i = 0; i < MAX_TARGETS; i++) {
+		if (postfx.targets[i].bitmap) {
+			al_destroy_bitmap(postfx.targets[i].bitmap);
+		}
+	}
+	if (postfx.checkerboard) {
+		al_destroy_bitmap(postfx.checkerboard);
+	}
+	memset(&postfx, 0, sizeof(postfx));
+}
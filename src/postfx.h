@@ -0,0 +1,11 @@
+#pragma once
+#include "common.h"
+
+ALLEGRO_BITMAP* AcquireRenderTarget(struct Game* game, bool nearest);
+void ReleaseRenderTarget(ALLEGRO_BITMAP* target);
+void BeginPixelated(struct Game* game);
+void EndPixelated(struct Game* game);
+void DrawZoomed(ALLEGRO_BITMAP* source, ALLEGRO_COLOR tint, float x, float y, float scale);
+void DrawOverlay(struct Game* game, ALLEGRO_SHADER* shader, ALLEGRO_COLOR color);
+void DrawCheckerboard(struct Game* game);
+void DestroyRenderTargets(void);
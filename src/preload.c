@@ -0,0 +1,162 @@
+/*! \file preload.c
+ *  \brief Decoding of the game's assets while the splash screens play.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "preload.h"
+#include "common.h"
+#include "diskcache.h"
+#include "loader.h"
+#include "pack.h"
+#include <libsuperderpy.h>
+
+// The game's gamestates are only loaded once the splash screens are over.
+// Until then, the files that take the longest to decode get decoded in the
+// background, and the gamestates take them from here when they load.
+
+static const char* BITMAPS[] = {"dell0.png", "dell1.png", "dell2.png", "dell3.png", "dell4.png", "dell5.png",
+	"fine.png", "notfine.png", "logo.png", "logobg.png", "meter.png", "marker.png"};
+static const char* SAMPLES[] = {"andnow.flac", "button.flac", "chimpology.flac", "fall.flac", "bdzium.flac",
+	"end.flac", "boom.flac"};
+
+#define BITMAP_COUNT (int)(sizeof(BITMAPS) / sizeof(BITMAPS[0]))
+#define SAMPLE_COUNT (int)(sizeof(SAMPLES) / sizeof(SAMPLES[0]))
+
+struct Preload {
+	struct Loader* loader;
+	ALLEGRO_MUTEX* mutex;
+	ALLEGRO_BITMAP* bitmaps[BITMAP_COUNT];
+	ALLEGRO_SAMPLE* samples[SAMPLE_COUNT];
+};
+
+void PreloadGame(struct Game* game) {
+	struct Preload* preload = calloc(1, sizeof(struct Preload));
+	preload->mutex = al_create_mutex();
+
+	// Plain memory bitmaps, so that the engine doesn't try to convert them
+	// while they're still being decoded; they get cloned when taken instead.
+	int flags = al_get_new_bitmap_flags();
+	al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+	preload->loader = CreateLoader(game);
+	al_set_new_bitmap_flags(flags);
+
+	for (int i = 0; i < BITMAP_COUNT; i++) {
+		LoadBitmapAsync(preload->loader, &preload->bitmaps[i], BITMAPS[i]);
+	}
+	for (int i = 0; i < SAMPLE_COUNT; i++) {
+		LoadSampleAsync(preload->loader, &preload->samples[i], SAMPLES[i]);
+	}
+	game->data->preload = preload;
+}
+
+static struct Preload* FinishPreload(struct Game* game) {
+	struct Preload* preload = game->data->preload;
+	if (!preload) {
+		return NULL;
+	}
+	al_lock_mutex(preload->mutex);
+	if (preload->loader) {
+		FinishLoader(preload->loader);
+		preload->loader = NULL;
+	}
+	al_unlock_mutex(preload->mutex);
+	return preload;
+}
+
+static int FindPreloaded(const char* list[], int count, const char* filename) {
+	for (int i = 0; i < count; i++) {
+		if (strcmp(list[i], filename) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+ALLEGRO_BITMAP* TakePreloadedBitmap(struct Game* game, const char* filename) {
+	// Returns NULL when the file wasn't preloaded or has already been taken.
+	// Waits for the preloading to finish otherwise.
+	int i = FindPreloaded(BITMAPS, BITMAP_COUNT, filename);
+	struct Preload* preload = i >= 0 ? FinishPreload(game) : NULL;
+	if (!preload) {
+		return NULL;
+	}
+	ALLEGRO_BITMAP* bitmap = NULL;
+	al_lock_mutex(preload->mutex);
+	if (preload->bitmaps[i]) {
+		// uses the flags of the calling thread, so the engine converts it to a video bitmap as usual
+		bitmap = al_clone_bitmap(preload->bitmaps[i]);
+		al_destroy_bitmap(preload->bitmaps[i]);
+		preload->bitmaps[i] = NULL;
+	}
+	al_unlock_mutex(preload->mutex);
+	return bitmap;
+}
+
+ALLEGRO_SAMPLE* TakePreloadedSample(struct Game* game, const char* filename) {
+	int i = FindPreloaded(SAMPLES, SAMPLE_COUNT, filename);
+	struct Preload* preload = i >= 0 ? FinishPreload(game) : NULL;
+	if (!preload) {
+		return NULL;
+	}
+	al_lock_mutex(preload->mutex);
+	ALLEGRO_SAMPLE* sample = preload->samples[i];
+	preload->samples[i] = NULL;
+	al_unlock_mutex(preload->mutex);
+	return sample;
+}
+
+ALLEGRO_BITMAP* LoadPreloadedBitmap(struct Game* game, const char* filename) {
+	ALLEGRO_BITMAP* bitmap = TakePreloadedBitmap(game, filename);
+	if (!bitmap) {
+		char* path = ResolveAsset(game, filename);
+		bitmap = LoadCachedBitmap(path);
+		free(path);
+	}
+	return bitmap;
+}
+
+ALLEGRO_SAMPLE* LoadPreloadedSample(struct Game* game, const char* filename) {
+	ALLEGRO_SAMPLE* sample = TakePreloadedSample(game, filename);
+	if (!sample) {
+		char* path = ResolveAsset(game, filename);
+		sample = LoadCachedSample(path);
+		free(path);
+	}
+	return sample;
+}
+
+void DestroyPreload(struct Game* game) {
+	struct Preload* preload = FinishPreload(game);
+	if (!preload) {
+		return;
+	}
+	for (int i = 0; i < BITMAP_COUNT; i++) {
+		if (preload->bitmaps[i]) {
+			al_destroy_bitmap(preload->bitmaps[i]);
+		}
+	}
+	for (int i = 0; i < SAMPLE_COUNT; i++) {
+		if (preload->samples[i]) {
+			al_destroy_sample(preload->samples[i]);
+		}
+	}
+	al_destroy_mutex(preload->mutex);
+	free(preload);
+	game->data->preload = NULL;
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include "common.h"
+
+void PreloadGame(struct Game* game);
+ALLEGRO_BITMAP* TakePreloadedBitmap(struct Game* game, const char* filename);
+ALLEGRO_SAMPLE* TakePreloadedSample(struct Game* game, const char* filename);
+ALLEGRO_BITMAP* LoadPreloadedBitmap(struct Game* game, const char* filename);
+ALLEGRO_SAMPLE* LoadPreloadedSample(struct Game* game, const char* filename);
+void DestroyPreload(struct Game* game);
@@ -0,0 +1,249 @@
+/*! \file profiler.c
+ *  \brief Frame time overlay, split by gamestate and by phase.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "profiler.h"
+#include "common.h"
+#include "trace.h"
+#include <allegro5/allegro_primitives.h>
+#include <libsuperderpy.h>
+#include <math.h>
+
+// Toggled with PROFILER_KEY. While it's on, every frame gets split into the
+// phases the engine goes through: events, logic (with ticks), drawing and
+// presenting the frame, measured between the global handlers the engine
+// calls around them. The engine has no hook right after the flip, so the
+// last phase also covers waiting for vsync, the frame timer and IdlePreLogic.
+// On top of that, gamestates measure their own callbacks with PROFILE scopes,
+// so gamestates running together (like fine and menu) show up separately.
+// The time spent on each row within a frame is kept for the last HISTORY
+// frames, drawn as a graph next to its p50 and p99.
+//
+// When tracing (see trace.c), the same measurements get written out as spans,
+// whether the overlay is on or not.
+
+#define PROFILER_KEY ALLEGRO_KEY_F3
+#define HISTORY 240
+#define MAX_ROWS 64
+#define GRAPH_SCALE 2.0 // pixels per millisecond
+#define ROW_HEIGHT 24
+#define TEXT_WIDTH (8 * 48) // 48 characters of the builtin font
+
+static const char* PHASE_NAMES[PROFILE_PHASES] = {"events", "logic", "tick", "timeline", "draw", "present+wait"};
+
+struct ProfileRow {
+	const char* gamestate; // NULL for the whole frame
+	enum ProfilePhase phase;
+	double current; // seconds spent in the frame being measured
+	float history[HISTORY]; // milliseconds
+};
+
+static struct {
+	bool enabled;
+	struct ProfileRow rows[MAX_ROWS];
+	int count;
+	int frame;
+	int phase; // of the whole frame, -1 when not measuring
+	double since;
+	ALLEGRO_FONT* font;
+} profiler;
+
+static int FindRow(const char* gamestate, enum ProfilePhase phase) {
+	for (int i = 0; i < profiler.count; i++) {
+		struct ProfileRow* row = &profiler.rows[i];
+		if (row->phase == phase && (row->gamestate == gamestate || (row->gamestate && gamestate && strcmp(row->gamestate, gamestate) == 0))) {
+			return i;
+		}
+	}
+	if (profiler.count == MAX_ROWS) {
+		return -1;
+	}
+	struct ProfileRow* row = &profiler.rows[profiler.count];
+	memset(row, 0, sizeof(struct ProfileRow));
+	row->gamestate = gamestate;
+	row->phase = phase;
+	return profiler.count++;
+}
+
+static bool Measuring(void) {
+	return profiler.enabled || IsTracing();
+}
+
+static void SwitchPhase(int phase) {
+	double now = al_get_time();
+	if (profiler.phase >= 0 && profiler.since) {
+		int row = profiler.enabled ? FindRow(NULL, profiler.phase) : -1;
+		if (row >= 0) {
+			profiler.rows[row].current += now - profiler.since;
+		}
+		TraceSpan("frame", PHASE_NAMES[profiler.phase], -1, profiler.since, now);
+	}
+	profiler.phase = phase;
+	profiler.since = now;
+}
+
+struct ProfileScope BeginProfile(struct Game* game, const char* gamestate, enum ProfilePhase phase) {
+	struct ProfileScope scope = {.gamestate = gamestate, .phase = phase, .row = -1};
+	if (Measuring()) {
+		scope.row = profiler.enabled ? FindRow(gamestate, phase) : -1;
+		scope.start = al_get_time();
+	}
+	return scope;
+}
+
+void EndProfile(struct ProfileScope* scope) {
+	if (!scope->start) {
+		return;
+	}
+	double now = al_get_time();
+	if (scope->row >= 0 && profiler.enabled) {
+		profiler.rows[scope->row].current += now - scope->start;
+	}
+	TraceSpan(scope->gamestate, PHASE_NAMES[scope->phase], -1, scope->start, now);
+}
+
+bool ProfilerEvent(struct Game* game, ALLEGRO_EVENT* event) {
+	// Returns true for the toggle key, which the gamestates shouldn't get.
+	if (event->type == ALLEGRO_EVENT_KEY_DOWN && event->keyboard.keycode == PROFILER_KEY) {
+		profiler.enabled = !profiler.enabled;
+		profiler.count = 0;
+		profiler.frame = 0;
+		profiler.phase = -1;
+		return true;
+	}
+	if (Measuring() && (profiler.phase == PROFILE_PRESENT || profiler.phase < 0)) {
+		SwitchPhase(PROFILE_EVENTS);
+	}
+	return false;
+}
+
+void ProfilerPreLogic(struct Game* game) {
+	if (Measuring()) {
+		SwitchPhase(PROFILE_LOGIC);
+	}
+}
+
+void ProfilerPostLogic(struct Game* game) {
+	if (Measuring()) {
+		SwitchPhase(PROFILE_EVENTS);
+	}
+}
+
+void ProfilerPreDraw(struct Game* game) {
+	if (Measuring()) {
+		SwitchPhase(PROFILE_DRAW);
+	}
+}
+
+static int CompareSamples(const void* a, const void* b) {
+	float s1 = *(const float*)a, s2 = *(const float*)b;
+	return (s1 > s2) - (s1 < s2);
+}
+
+static void DrawRow(struct ProfileRow* row, int frames, int columns, float x, float y) {
+	// The graph shows only the last columns frames, the percentiles cover all of them.
+	float sorted[HISTORY];
+	memcpy(sorted, row->history, frames * sizeof(float));
+	qsort(sorted, frames, sizeof(float), CompareSamples);
+	float p50 = sorted[frames / 2], p99 = sorted[(int)((frames - 1) * 0.99)];
+
+	al_draw_textf(profiler.font, al_map_rgb(255, 255, 255), x, y, ALLEGRO_ALIGN_LEFT, "%-10s %-12s p50 %6.2f p99 %6.2f ms",
+		row->gamestate ? row->gamestate : "frame", PHASE_NAMES[row->phase], p50, p99);
+
+	// oldest frame on the left
+	ALLEGRO_VERTEX vertices[HISTORY * 2];
+	float bottom = y + ROW_HEIGHT - 2, left = x + TEXT_WIDTH;
+	ALLEGRO_COLOR color = p99 > 1000 / 60.0 ? al_map_rgb(255, 64, 64) : al_map_rgb(64, 255, 64);
+	for (int i = 0; i < columns; i++) {
+		float sample = row->history[(profiler.frame - columns + i + HISTORY) % HISTORY];
+		float height = fmin(sample * GRAPH_SCALE, ROW_HEIGHT - 2);
+		vertices[i * 2] = (ALLEGRO_VERTEX){.x = left + i + 0.5, .y = bottom, .color = color};
+		vertices[i * 2 + 1] = (ALLEGRO_VERTEX){.x = left + i + 0.5, .y = bottom - height, .color = color};
+	}
+	al_draw_prim(vertices, NULL, NULL, 0, columns * 2, ALLEGRO_PRIM_LINE_LIST);
+}
+
+static void DrawProfiler(struct Game* game) {
+	if (!profiler.font) {
+		profiler.font = al_create_builtin_font();
+	}
+	int frames = profiler.frame < HISTORY ? profiler.frame : HISTORY;
+	if (!frames) {
+		return;
+	}
+
+	// Drawn in display pixels. The graphs get only as many frames as fit next to
+	// the text, and when even the text doesn't fit, everything gets scaled down.
+	ALLEGRO_TRANSFORM transform, fit;
+	al_copy_transform(&transform, al_get_current_transform());
+	al_set_target_backbuffer(game->display);
+	int displaywidth = al_get_display_width(game->display), displayheight = al_get_display_height(game->display);
+	int columns = displaywidth - TEXT_WIDTH - 8;
+	if (columns > frames) {
+		columns = frames;
+	}
+	if (columns < 0) {
+		columns = 0;
+	}
+	float width = TEXT_WIDTH + columns + 8, height = profiler.count * ROW_HEIGHT + 8;
+	float scale = fmin(1.0, fmin(displaywidth / width, displayheight / height));
+	al_identity_transform(&fit);
+	al_scale_transform(&fit, scale, scale);
+	al_use_transform(&fit);
+
+	al_draw_filled_rectangle(0, 0, width, height, al_map_rgba(0, 0, 0, 192));
+	// whole frame first, then gamestates in the order they showed up
+	int line = 0;
+	for (int pass = 0; pass < 2; pass++) {
+		for (int i = 0; i < profiler.count; i++) {
+			if (!profiler.rows[i].gamestate == !pass) {
+				DrawRow(&profiler.rows[i], frames, columns, 4, 4 + line++ * ROW_HEIGHT);
+			}
+		}
+	}
+
+	al_use_transform(&transform);
+}
+
+void ProfilerPostDraw(struct Game* game) {
+	if (!Measuring()) {
+		return;
+	}
+	SwitchPhase(PROFILE_PRESENT);
+	if (!profiler.enabled) {
+		return;
+	}
+	for (int i = 0; i < profiler.count; i++) {
+		profiler.rows[i].history[profiler.frame % HISTORY] = profiler.rows[i].current * 1000;
+		profiler.rows[i].current = 0;
+	}
+	profiler.frame++;
+
+	DrawProfiler(game);
+	profiler.since = al_get_time(); // don't count the overlay itself
+}
+
+void DestroyProfiler(void) {
+	if (profiler.font) {
+		al_destroy_font(profiler.font);
+	}
+	profiler.font = NULL;
+	profiler.enabled = false;
+}
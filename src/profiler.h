@@ -0,0 +1,32 @@
+#pragma once
+#include "common.h"
+
+enum ProfilePhase {
+	PROFILE_EVENTS,
+	PROFILE_LOGIC,
+	PROFILE_TICK,
+	PROFILE_TIMELINE,
+	PROFILE_DRAW,
+	PROFILE_PRESENT, // flipping the display and waiting for the next frame
+	PROFILE_PHASES
+};
+
+struct ProfileScope {
+	const char* gamestate;
+	enum ProfilePhase phase;
+	int row; // -1 when not shown in the overlay
+	double start; // 0 when neither profiling nor tracing
+};
+
+// Measures the rest of the enclosing block, e.g. PROFILE(game, "walk", PROFILE_DRAW);
+#define PROFILE(game, gamestate, phase) \
+	struct ProfileScope profile_scope __attribute__((cleanup(EndProfile))) = BeginProfile(game, gamestate, phase)
+
+struct ProfileScope BeginProfile(struct Game* game, const char* gamestate, enum ProfilePhase phase);
+void EndProfile(struct ProfileScope* scope);
+bool ProfilerEvent(struct Game* game, ALLEGRO_EVENT* event);
+void ProfilerPreLogic(struct Game* game);
+void ProfilerPostLogic(struct Game* game);
+void ProfilerPreDraw(struct Game* game);
+void ProfilerPostDraw(struct Game* game);
+void DestroyProfiler(void);
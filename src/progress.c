@@ -0,0 +1,110 @@
+/*! \file progress.c
+ *  \brief Loading progress reported on a time budget.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "progress.h"
+#include "common.h"
+#include "trace.h"
+#include <libsuperderpy.h>
+#include <stdio.h>
+
+// Every call to the engine's progress callback may redraw the loading screen
+// and wait for the display to flip, so reporting each small loading step
+// paces the whole load by the refresh rate. Instead, the engine only gets
+// PROGRESS_TICKS calls per gamestate, spaced at least PROGRESS_INTERVAL
+// apart. How far the loading went is estimated from how long it took the
+// last time (saved in the config file), or from the number of steps done
+// when there's no measurement yet.
+//
+// Gamestates are loaded one at a time, so a single state is enough.
+//
+// When tracing, each loading step and each call to the engine's callback
+// gets its own span.
+
+#define PROGRESS_INTERVAL (1 / 20.0)
+
+static struct {
+	struct Game* game;
+	char* name;
+	ProgressCallback progress;
+	int steps, done, ticks;
+	double start, last, estimate, step;
+} state;
+
+static void Report(struct Game* game) {
+	double start = al_get_time();
+	state.ticks++;
+	state.progress(game);
+	TraceSpan("progress", state.name, state.ticks, start, al_get_time());
+}
+
+static void Tick(struct Game* game) {
+	state.done++;
+	double now = al_get_time();
+	TraceSpan("load step", state.name, state.done, state.step, now);
+	state.step = now;
+	if (now - state.last < PROGRESS_INTERVAL) {
+		return;
+	}
+
+	double fraction;
+	if (state.estimate > 0) {
+		fraction = (now - state.start) / state.estimate;
+	} else {
+		fraction = state.done / (double)state.steps;
+	}
+	// the last tick is left for EndProgress
+	int ticks = fraction * PROGRESS_TICKS;
+	if (ticks > PROGRESS_TICKS - 1) {
+		ticks = PROGRESS_TICKS - 1;
+	}
+	if (ticks > state.ticks) {
+		state.last = now;
+		Report(game); // one tick at a time, so they don't come in bursts either
+		state.step = al_get_time();
+	}
+}
+
+ProgressCallback BeginProgress(struct Game* game, char* name, ProgressCallback progress, int steps) {
+	// Returns the callback to pass around instead of the engine's one.
+	state.game = game;
+	state.name = name;
+	state.progress = progress;
+	state.steps = steps;
+	state.done = 0;
+	state.ticks = 0;
+	state.start = al_get_time();
+	state.last = state.start;
+	state.step = state.start;
+	state.estimate = atof(GetConfigOptionDefault(game, "loading", name, "0"));
+	return Tick;
+}
+
+void EndProgress(struct Game* game) {
+	double duration = al_get_time() - state.start;
+	char value[32];
+	snprintf(value, 32, "%f", duration);
+	SetConfigOption(game, "loading", state.name, value);
+
+	TraceSpan("load step", state.name, state.done + 1, state.step, al_get_time());
+	while (state.ticks < PROGRESS_TICKS) {
+		Report(game);
+	}
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include "common.h"
+
+#define PROGRESS_TICKS 10 // Gamestate_ProgressCount of gamestates using BeginProgress
+
+typedef void (*ProgressCallback)(struct Game*);
+
+ProgressCallback BeginProgress(struct Game* game, char* name, ProgressCallback progress, int steps);
+void EndProgress(struct Game* game);
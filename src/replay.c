@@ -0,0 +1,210 @@
+/*! \file replay.c
+ *  \brief Recording and replaying of input sessions.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "replay.h"
+#include "common.h"
+#include <inttypes.h>
+#include <libsuperderpy.h>
+#include <stdio.h>
+#include <time.h>
+
+// Started with --record <file>, the game writes down the seed of the random
+// number generator and every key and touch event together with the logic tick
+// it arrived at. Started with --replay <file>, it seeds the generator the same
+// way, ignores live input and feeds the recorded events back to the
+// gamestates, so the same session can be played against different builds.
+//
+// Time is counted in fixed 1/60 s ticks rather than seconds, so an event
+// always lands on the same tick no matter how long loading or individual
+// frames took. In headless mode every frame is exactly one tick, and the
+// game quits once the whole recording has been played. Recorded events are
+// emitted through the engine's user event source right after the logic step
+// that reached their tick, and GlobalEventHandler turns
+// them back into the original events before the gamestates get to see them.
+// Touch coordinates are kept in window space, so replaying a touch session
+// needs the same window size.
+//
+// File format (text): "seed <seed>" line, followed by a line per event:
+//   <tick> <type> <keycode> <unichar> <modifiers> <x> <y> <touch id> <primary>
+// ending with a line of type 0 at the tick the recording stopped.
+
+#define TICK (1 / 60.0)
+
+#define REPLAY_EVENT ALLEGRO_GET_EVENT_TYPE('R', 'P', 'L', 'Y')
+
+struct RecordedEvent {
+	int64_t tick;
+	ALLEGRO_EVENT event;
+};
+
+static struct {
+	FILE* file; // being recorded to
+	struct RecordedEvent* events; // being replayed
+	int count, next;
+	int64_t tick;
+	double accumulator; // time not making a full tick yet
+} replay;
+
+static bool IsInput(ALLEGRO_EVENT* event) {
+	switch (event->type) {
+		case ALLEGRO_EVENT_KEY_DOWN:
+		case ALLEGRO_EVENT_KEY_UP:
+		case ALLEGRO_EVENT_KEY_CHAR:
+		case ALLEGRO_EVENT_TOUCH_BEGIN:
+		case ALLEGRO_EVENT_TOUCH_END:
+		case ALLEGRO_EVENT_TOUCH_MOVE:
+		case ALLEGRO_EVENT_TOUCH_CANCEL:
+			return true;
+		default:
+			return false;
+	}
+}
+
+static bool IsTouch(int type) {
+	return type == ALLEGRO_EVENT_TOUCH_BEGIN || type == ALLEGRO_EVENT_TOUCH_END || type == ALLEGRO_EVENT_TOUCH_MOVE || type == ALLEGRO_EVENT_TOUCH_CANCEL;
+}
+
+static unsigned int LoadReplay(const char* filename) {
+	FILE* file = fopen(filename, "r");
+	unsigned int seed;
+	if (!file || fscanf(file, "seed %u\n", &seed) != 1) {
+		fprintf(stderr, "Could not read replay %s, playing normally.\n", filename);
+		if (file) {
+			fclose(file);
+		}
+		return time(NULL);
+	}
+
+	int size = 0, type, keycode, unichar, id, primary;
+	unsigned int modifiers;
+	int64_t tick;
+	float x, y;
+	while (fscanf(file, "%" SCNd64 " %d %d %d %u %f %f %d %d\n", &tick, &type, &keycode, &unichar, &modifiers, &x, &y, &id, &primary) == 9) {
+		if (replay.count == size) {
+			size = size ? size * 2 : 256;
+			replay.events = realloc(replay.events, size * sizeof(struct RecordedEvent));
+		}
+		struct RecordedEvent* recorded = &replay.events[replay.count++];
+		memset(recorded, 0, sizeof(struct RecordedEvent));
+		recorded->tick = tick;
+		recorded->event.type = type;
+		if (IsTouch(type)) {
+			recorded->event.touch.x = x;
+			recorded->event.touch.y = y;
+			recorded->event.touch.id = id;
+			recorded->event.touch.primary = primary;
+		} else {
+			recorded->event.keyboard.keycode = keycode;
+			recorded->event.keyboard.unichar = unichar;
+			recorded->event.keyboard.modifiers = modifiers;
+		}
+	}
+	fclose(file);
+	printf("Replaying %d events from %s.\n", replay.count, filename);
+	return seed;
+}
+
+unsigned int StartReplay(int argc, char** argv) {
+	// Returns the seed for the random number generator.
+	for (int i = 1; i + 1 < argc; i++) {
+		if (strcmp(argv[i], "--replay") == 0) {
+			return LoadReplay(argv[i + 1]);
+		}
+	}
+
+	unsigned int seed = time(NULL);
+	for (int i = 1; i + 1 < argc; i++) {
+		if (strcmp(argv[i], "--record") == 0) {
+			replay.file = fopen(argv[i + 1], "w");
+			if (!replay.file) {
+				fprintf(stderr, "Could not open %s for recording!\n", argv[i + 1]);
+				break;
+			}
+			fprintf(replay.file, "seed %u\n", seed);
+		}
+	}
+	return seed;
+}
+
+bool HandleReplayEvent(struct Game* game, ALLEGRO_EVENT* event) {
+	// Returns true for events that should be dropped.
+	if (event->type == REPLAY_EVENT) {
+		*event = replay.events[event->user.data1].event;
+		event->any.timestamp = al_get_time();
+		if (IsTouch(event->type)) {
+			event->touch.display = game->display;
+		} else {
+			event->keyboard.display = game->display;
+		}
+		return false;
+	}
+	if (!IsInput(event)) {
+		return false;
+	}
+
+	if (replay.file) {
+		bool touch = IsTouch(event->type);
+		fprintf(replay.file, "%" PRId64 " %d %d %d %u %f %f %d %d\n", replay.tick, event->type,
+			touch ? 0 : event->keyboard.keycode, touch ? 0 : event->keyboard.unichar, touch ? 0 : event->keyboard.modifiers,
+			touch ? event->touch.x : 0, touch ? event->touch.y : 0, touch ? event->touch.id : 0, touch ? event->touch.primary : 0);
+		fflush(replay.file);
+	}
+
+	// live input is ignored until the replay is over
+	return replay.next < replay.count;
+}
+
+void ReplayLogic(struct Game* game, double delta) {
+	if (game->data->headless) {
+		replay.tick++;
+	} else {
+		replay.accumulator += delta;
+		while (replay.accumulator >= TICK) {
+			replay.accumulator -= TICK;
+			replay.tick++;
+		}
+	}
+	while (replay.next < replay.count && replay.events[replay.next].tick <= replay.tick) {
+		if (replay.events[replay.next].event.type) {
+			ALLEGRO_EVENT event = {.user = {.type = REPLAY_EVENT, .data1 = replay.next}};
+			al_emit_user_event(&game->event_source, &event, NULL);
+		}
+		replay.next++;
+		if (replay.next == replay.count) {
+			PrintConsole(game, "Replay finished.");
+			if (game->data->headless) {
+				UnloadAllGamestates(game); // which quits the engine
+			}
+		}
+	}
+}
+
+void StopReplay(void) {
+	if (replay.file) {
+		fprintf(replay.file, "%" PRId64 " 0 0 0 0 0 0 0 0\n", replay.tick);
+		fclose(replay.file);
+	}
+	free(replay.events);
+	replay.file = NULL;
+	replay.events = NULL;
+	replay.count = 0;
+	replay.next = 0;
+}
@@ -0,0 +1,7 @@
+#pragma once
+#include "common.h"
+
+unsigned int StartReplay(int argc, char** argv);
+bool HandleReplayEvent(struct Game* game, ALLEGRO_EVENT* event);
+void ReplayLogic(struct Game* game, double delta);
+void StopReplay(void);
@@ -0,0 +1,105 @@
+/*! \file restore.c
+ *  \brief Bringing back GPU resources after the context gets lost.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "restore.h"
+#include "common.h"
+#include "trace.h"
+#include <libsuperderpy.h>
+
+// Textures created with ALLEGRO_NO_PRESERVE_TEXTURE don't get backed up by
+// Allegro when the app gets suspended (on Android) or the device gets lost
+// (with Direct3D). That saves reading all of them back from the GPU right
+// when the system wants us gone, but their contents are lost afterwards.
+// Whatever owns such a texture tracks it here together with a callback that
+// brings the contents back, usually from a compact copy kept in memory or by
+// marking it to be redrawn.
+//
+// All of them get restored in one batch before the first frame drawn after
+// the context is back, rather than from each gamestate's Gamestate_Reload.
+
+struct TrackedResource {
+	void* resource;
+	RestoreCallback restore;
+};
+
+static struct {
+	struct TrackedResource* resources;
+	int count, allocated;
+	bool pending;
+	ALLEGRO_MUTEX* mutex; // resources get tracked from loading threads too
+} restore;
+
+void InitRestore(struct Game* game) {
+	restore.mutex = al_create_mutex();
+}
+
+void TrackResource(void* resource, RestoreCallback callback) {
+	al_lock_mutex(restore.mutex);
+	if (restore.count == restore.allocated) {
+		restore.allocated = restore.allocated ? restore.allocated * 2 : 16;
+		restore.resources = realloc(restore.resources, restore.allocated * sizeof(struct TrackedResource));
+	}
+	restore.resources[restore.count++] = (struct TrackedResource){.resource = resource, .restore = callback};
+	al_unlock_mutex(restore.mutex);
+}
+
+void UntrackResource(void* resource) {
+	al_lock_mutex(restore.mutex);
+	for (int i = 0; i < restore.count; i++) {
+		if (restore.resources[i].resource == resource) {
+			restore.resources[i] = restore.resources[--restore.count];
+			break;
+		}
+	}
+	al_unlock_mutex(restore.mutex);
+}
+
+void RestoreEvent(struct Game* game, ALLEGRO_EVENT* event) {
+	// The engine acknowledges these only after the global handler, so the
+	// context can't be used until the next frame.
+	if (event->type == ALLEGRO_EVENT_DISPLAY_RESUME_DRAWING || event->type == ALLEGRO_EVENT_DISPLAY_FOUND) {
+		restore.pending = true;
+	}
+}
+
+void RestorePreDraw(struct Game* game) {
+	if (!restore.pending) {
+		return;
+	}
+	restore.pending = false;
+	TRACE("restore", "context");
+	double start = al_get_time();
+	al_lock_mutex(restore.mutex);
+	for (int i = 0; i < restore.count; i++) {
+		restore.resources[i].restore(game, restore.resources[i].resource);
+	}
+	int count = restore.count;
+	al_unlock_mutex(restore.mutex);
+	PrintConsole(game, "Restored %d GPU resources in %.1f ms.", count, (al_get_time() - start) * 1000);
+}
+
+void DestroyRestore(void) {
+	free(restore.resources);
+	if (restore.mutex) {
+		al_destroy_mutex(restore.mutex);
+	}
+	memset(&restore, 0, sizeof(restore));
+}
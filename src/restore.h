@@ -0,0 +1,11 @@
+#pragma once
+#include "common.h"
+
+typedef void (*RestoreCallback)(struct Game* game, void* resource);
+
+void InitRestore(struct Game* game);
+void TrackResource(void* resource, RestoreCallback restore);
+void UntrackResource(void* resource);
+void RestoreEvent(struct Game* game, ALLEGRO_EVENT* event);
+void RestorePreDraw(struct Game* game);
+void DestroyRestore(void);
@@ -0,0 +1,178 @@
+/*! \file text.c
+ *  \brief Strings rendered into textures once and drawn as single quads.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "text.h"
+#include "common.h"
+#include "restore.h"
+#include <libsuperderpy.h>
+#include <limits.h>
+#include <math.h>
+
+// Drawing a string means a quad for every glyph, twice when it has a shadow.
+// Most of the game's text stays the same for many frames though, so it gets
+// rendered into a texture of its own, together with its shadow, and drawn
+// with a single quad until it changes. Setting the same text again is just
+// a string comparison, and the rendering itself is deferred to the next
+// draw, so cached texts can be set up from loading threads too.
+//
+// A cached text can consist of several parts drawn at their own offsets,
+// like characters overlapping each other or multiple lines.
+
+struct CachedPart {
+	char* text;
+	int x, y;
+};
+
+struct CachedText {
+	ALLEGRO_FONT* font;
+	ALLEGRO_COLOR color;
+	bool shadow, dirty;
+	struct CachedPart* parts;
+	int count;
+	ALLEGRO_BITMAP* bitmap;
+	int left, top; // of the bitmap, relative to the drawing position
+	int width; // for aligning
+};
+
+static void Invalidate(struct Game* game, void* text) {
+	((struct CachedText*)text)->dirty = true;
+}
+
+struct CachedText* CreateCachedText(struct Game* game, ALLEGRO_FONT* font, ALLEGRO_COLOR color, bool shadow) {
+	struct CachedText* text = calloc(1, sizeof(struct CachedText));
+	text->font = font;
+	text->color = color;
+	text->shadow = shadow;
+	TrackResource(text, Invalidate);
+	return text;
+}
+
+static void ClearParts(struct CachedText* text) {
+	for (int i = 0; i < text->count; i++) {
+		free(text->parts[i].text);
+	}
+	free(text->parts);
+	text->parts = NULL;
+	text->count = 0;
+}
+
+void SetCachedTextParts(struct CachedText* text, int count, const struct TextPart parts[]) {
+	if (count == text->count) {
+		bool same = true;
+		for (int i = 0; i < count && same; i++) {
+			same = parts[i].x == text->parts[i].x && parts[i].y == text->parts[i].y && strcmp(parts[i].text, text->parts[i].text) == 0;
+		}
+		if (same) {
+			return;
+		}
+	}
+	ClearParts(text);
+	text->parts = calloc(count, sizeof(struct CachedPart));
+	text->count = count;
+	for (int i = 0; i < count; i++) {
+		text->parts[i] = (struct CachedPart){.text = strdup(parts[i].text), .x = parts[i].x, .y = parts[i].y};
+	}
+	text->dirty = true;
+}
+
+void SetCachedText(struct CachedText* text, const char* str) {
+	SetCachedTextParts(text, 1, (struct TextPart[]){{.text = str}});
+}
+
+static void Render(struct Game* game, struct CachedText* text) {
+	text->dirty = false;
+	int x1 = INT_MAX, y1 = INT_MAX, x2 = INT_MIN, y2 = INT_MIN;
+	text->width = 0;
+	for (int i = 0; i < text->count; i++) {
+		struct CachedPart* part = &text->parts[i];
+		int bbx, bby, bbw, bbh;
+		al_get_text_dimensions(text->font, part->text, &bbx, &bby, &bbw, &bbh);
+		if (!bbw || !bbh) {
+			continue;
+		}
+		x1 = fmin(x1, part->x + bbx);
+		y1 = fmin(y1, part->y + bby);
+		x2 = fmax(x2, part->x + bbx + bbw + text->shadow);
+		y2 = fmax(y2, part->y + bby + bbh + text->shadow);
+		text->width = fmax(text->width, part->x + al_get_text_width(text->font, part->text));
+	}
+
+	if (x1 >= x2 || y1 >= y2) {
+		if (text->bitmap) {
+			al_destroy_bitmap(text->bitmap);
+		}
+		text->bitmap = NULL;
+		return;
+	}
+	if (text->bitmap && (al_get_bitmap_width(text->bitmap) != x2 - x1 || al_get_bitmap_height(text->bitmap) != y2 - y1)) {
+		al_destroy_bitmap(text->bitmap);
+		text->bitmap = NULL;
+	}
+	if (!text->bitmap) {
+		int flags = al_get_new_bitmap_flags();
+		al_add_new_bitmap_flag(ALLEGRO_NO_PRESERVE_TEXTURE);
+		text->bitmap = al_create_bitmap(x2 - x1, y2 - y1);
+		al_set_new_bitmap_flags(flags);
+		if (!text->bitmap) {
+			return;
+		}
+	}
+	text->left = x1;
+	text->top = y1;
+
+	ALLEGRO_BITMAP* target = al_get_target_bitmap();
+	al_set_target_bitmap(text->bitmap);
+	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+	for (int i = 0; i < text->count; i++) {
+		struct CachedPart* part = &text->parts[i];
+		if (text->shadow) {
+			// same as DrawTextWithShadow
+			al_draw_text(text->font, al_map_rgba(0, 0, 0, 128), part->x - x1 + 1, part->y - y1 + 1, ALLEGRO_ALIGN_LEFT, part->text);
+		}
+		al_draw_text(text->font, text->color, part->x - x1, part->y - y1, ALLEGRO_ALIGN_LEFT, part->text);
+	}
+	al_set_target_bitmap(target);
+}
+
+void DrawCachedText(struct Game* game, struct CachedText* text, float x, float y, int flags) {
+	// Aligned like al_draw_text, with ALLEGRO_ALIGN_INTEGER implied.
+	if (text->dirty) {
+		Render(game, text);
+	}
+	if (!text->bitmap) {
+		return;
+	}
+	if (flags & ALLEGRO_ALIGN_CENTRE) {
+		x -= text->width / 2.0;
+	} else if (flags & ALLEGRO_ALIGN_RIGHT) {
+		x -= text->width;
+	}
+	al_draw_bitmap(text->bitmap, floorf(x) + text->left, floorf(y) + text->top, 0);
+}
+
+void DestroyCachedText(struct CachedText* text) {
+	UntrackResource(text);
+	ClearParts(text);
+	if (text->bitmap) {
+		al_destroy_bitmap(text->bitmap);
+	}
+	free(text);
+}
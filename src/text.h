@@ -0,0 +1,13 @@
+#pragma once
+#include "common.h"
+
+struct TextPart {
+	const char* text;
+	int x, y;
+};
+
+struct CachedText* CreateCachedText(struct Game* game, ALLEGRO_FONT* font, ALLEGRO_COLOR color, bool shadow);
+void SetCachedText(struct CachedText* text, const char* str);
+void SetCachedTextParts(struct CachedText* text, int count, const struct TextPart parts[]);
+void DrawCachedText(struct Game* game, struct CachedText* text, float x, float y, int flags);
+void DestroyCachedText(struct CachedText* text);
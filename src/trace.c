@@ -0,0 +1,117 @@
+/*! \file trace.c
+ *  \brief Trace event output for Chrome's trace viewer and Perfetto.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "trace.h"
+#include "common.h"
+#include <libsuperderpy.h>
+#include <stdio.h>
+
+// Started with --trace <file>, the game writes a span for every loading step
+// and progress report, every timeline action, every asset decoded by the
+// loader, and every phase of every frame (see profiler.c) into a JSON file
+// that can be opened in chrome://tracing or ui.perfetto.dev. Spans are
+// written as soon as they end, from whichever thread they were on, so each
+// thread gets its own track.
+
+static struct {
+	FILE* file;
+	ALLEGRO_MUTEX* mutex;
+	int threads;
+	bool first;
+} trace;
+
+static __thread int thread_id;
+
+void StartTrace(int argc, char** argv) {
+	for (int i = 1; i + 1 < argc; i++) {
+		if (strcmp(argv[i], "--trace") == 0) {
+			trace.file = fopen(argv[i + 1], "w");
+			if (!trace.file) {
+				fprintf(stderr, "Could not open %s for tracing!\n", argv[i + 1]);
+				return;
+			}
+			trace.mutex = al_create_mutex();
+			trace.first = true;
+			fprintf(trace.file, "{\"traceEvents\":[\n");
+			thread_id = ++trace.threads; // the main thread gets the first track
+			return;
+		}
+	}
+}
+
+bool IsTracing(void) {
+	return trace.file;
+}
+
+static void WriteString(const char* str) {
+	fputc('"', trace.file);
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\') {
+			fputc('\\', trace.file);
+		}
+		if ((unsigned char)*str >= 0x20) {
+			fputc(*str, trace.file);
+		}
+	}
+	fputc('"', trace.file);
+}
+
+void TraceSpan(const char* category, const char* name, int arg, double start, double end) {
+	// Times as returned by al_get_time. The arg is left out when negative.
+	if (!trace.file) {
+		return;
+	}
+	al_lock_mutex(trace.mutex);
+	if (!thread_id) {
+		thread_id = ++trace.threads;
+	}
+	fprintf(trace.file, "%s{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.1f,\"dur\":%.1f,\"cat\":", trace.first ? "" : ",\n",
+		thread_id, start * 1000000, (end - start) * 1000000);
+	WriteString(category);
+	fprintf(trace.file, ",\"name\":");
+	WriteString(name);
+	if (arg >= 0) {
+		fprintf(trace.file, ",\"args\":{\"n\":%d}", arg);
+	}
+	fputc('}', trace.file);
+	trace.first = false;
+	al_unlock_mutex(trace.mutex);
+}
+
+struct TraceScope BeginTrace(const char* category, const char* name) {
+	return (struct TraceScope){.category = category, .name = name, .start = trace.file ? al_get_time() : 0};
+}
+
+void EndTrace(struct TraceScope* scope) {
+	if (scope->start) {
+		TraceSpan(scope->category, scope->name, -1, scope->start, al_get_time());
+	}
+}
+
+void StopTrace(void) {
+	if (!trace.file) {
+		return;
+	}
+	fprintf(trace.file, "\n]}\n");
+	fclose(trace.file);
+	al_destroy_mutex(trace.mutex);
+	trace.file = NULL;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "common.h"
+
+struct TraceScope {
+	const char *category, *name;
+	double start; // 0 when not tracing
+};
+
+// Traces the rest of the enclosing block, e.g. TRACE("load", "walk");
+#define TRACE(category, name) \
+	struct TraceScope trace_scope __attribute__((cleanup(EndTrace))) = BeginTrace(category, name)
+
+// Defines a static timeline action that traces each of its calls, e.g. TRACED_ACTION(Move) { ... }
+#define TRACED_ACTION(name) \
+	static TM_ACTION(name##_traced); \
+	static TM_ACTION(name) { \
+		TRACE("action", #name); \
+		return name##_traced(game, data, action); \
+	} \
+	static TM_ACTION(name##_traced)
+
+void StartTrace(int argc, char** argv);
+bool IsTracing(void);
+void TraceSpan(const char* category, const char* name, int arg, double start, double end);
+struct TraceScope BeginTrace(const char* category, const char* name);
+void EndTrace(struct TraceScope* scope);
+void StopTrace(void);
@@ -0,0 +1,235 @@
+/*! \file atlaspack.c
+ *  \brief Build-time packer that puts spritesheets into texture atlases.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Usage: atlaspack <output dir> <page size> <name>=<spritesheet.ini or image.png>...
+//
+// Writes atlas0.png, atlas1.png, ... and an atlas.ini manifest into the output dir.
+// Every packed sprite gets a section in the manifest:
+//   page - index of the atlas page
+//   x, y, w, h - region of the page that holds the (trimmed) image
+//   ox, oy - offset of the trimmed image within the original one
+//   width, height - size of the original image
+// Only plain images get their transparent borders trimmed. Spritesheets are packed
+// as they are, so the game can hand their regions to the engine in place of the
+// files. Images that don't fit on a page are left out.
+
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_image.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PADDING 1
+
+struct Sprite {
+	char* name;
+	ALLEGRO_BITMAP* bitmap;
+	int ox, oy, w, h; // trimmed region
+	int page, x, y;
+};
+
+static ALLEGRO_BITMAP* LoadSprite(const char* path, bool* trim) {
+	*trim = true;
+	if (strcmp(strrchr(path, '.'), ".ini") != 0) {
+		return al_load_bitmap(path);
+	}
+
+	ALLEGRO_CONFIG* config = al_load_config_file(path);
+	if (!config) {
+		return NULL;
+	}
+	const char* file = al_get_config_value(config, "animation", "file");
+	*trim = false;
+
+	ALLEGRO_BITMAP* bitmap = NULL;
+	if (file) {
+		ALLEGRO_PATH* filepath = al_create_path(path);
+		al_set_path_filename(filepath, file);
+		bitmap = al_load_bitmap(al_path_cstr(filepath, ALLEGRO_NATIVE_PATH_SEP));
+		al_destroy_path(filepath);
+	}
+	al_destroy_config(config);
+	return bitmap;
+}
+
+static void Trim(struct Sprite* sprite) {
+	int width = al_get_bitmap_width(sprite->bitmap), height = al_get_bitmap_height(sprite->bitmap);
+	int x1 = width, y1 = height, x2 = 0, y2 = 0;
+
+	al_lock_bitmap(sprite->bitmap, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_READONLY);
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			unsigned char r, g, b, a;
+			al_unmap_rgba(al_get_pixel(sprite->bitmap, x, y), &r, &g, &b, &a);
+			if (a) {
+				if (x < x1) x1 = x;
+				if (y < y1) y1 = y;
+				if (x + 1 > x2) x2 = x + 1;
+				if (y + 1 > y2) y2 = y + 1;
+			}
+		}
+	}
+	al_unlock_bitmap(sprite->bitmap);
+
+	if (x1 >= x2 || y1 >= y2) {
+		// fully transparent, keep a single pixel
+		x1 = 0;
+		y1 = 0;
+		x2 = 1;
+		y2 = 1;
+	}
+	sprite->ox = x1;
+	sprite->oy = y1;
+	sprite->w = x2 - x1;
+	sprite->h = y2 - y1;
+}
+
+static int CompareSprites(const void* a, const void* b) {
+	const struct Sprite *s1 = a, *s2 = b;
+	if (s1->h != s2->h) {
+		return s2->h - s1->h;
+	}
+	return strcmp(s1->name, s2->name);
+}
+
+int main(int argc, char** argv) {
+	if (argc < 4) {
+		fprintf(stderr, "Usage: %s <output dir> <page size> <name>=<file>...\n", argv[0]);
+		return 1;
+	}
+
+	if (!al_init() || !al_init_image_addon()) {
+		fprintf(stderr, "Could not initialize Allegro!\n");
+		return 1;
+	}
+	al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+
+	const char* output = argv[1];
+	int size = atoi(argv[2]);
+	int count = 0;
+	struct Sprite* sprites = calloc(argc - 3, sizeof(struct Sprite));
+
+	for (int i = 3; i < argc; i++) {
+		char* name = strdup(argv[i]);
+		char* path = strchr(name, '=');
+		if (!path) {
+			fprintf(stderr, "Invalid argument: %s\n", argv[i]);
+			return 1;
+		}
+		*path = 0;
+		path++;
+
+		bool trim;
+		ALLEGRO_BITMAP* bitmap = LoadSprite(path, &trim);
+		if (!bitmap) {
+			fprintf(stderr, "Could not load %s!\n", path);
+			return 1;
+		}
+
+		struct Sprite* sprite = &sprites[count];
+		sprite->name = name;
+		sprite->bitmap = bitmap;
+		sprite->w = al_get_bitmap_width(bitmap);
+		sprite->h = al_get_bitmap_height(bitmap);
+		if (trim) {
+			Trim(sprite);
+		}
+
+		if (sprite->w + PADDING > size || sprite->h + PADDING > size) {
+			fprintf(stderr, "%s does not fit on an atlas page, skipping.\n", name);
+			al_destroy_bitmap(bitmap);
+			free(name);
+			continue;
+		}
+		count++;
+	}
+
+	// simple shelf packing, tallest sprites first
+	qsort(sprites, count, sizeof(struct Sprite), CompareSprites);
+	int page = 0, x = 0, y = 0, height = 0;
+	for (int i = 0; i < count; i++) {
+		int w = sprites[i].w + PADDING, h = sprites[i].h + PADDING;
+		if (x + w > size) {
+			x = 0;
+			y += height;
+			height = 0;
+		}
+		if (y + h > size) {
+			page++;
+			x = 0;
+			y = 0;
+			height = 0;
+		}
+		sprites[i].page = page;
+		sprites[i].x = x;
+		sprites[i].y = y;
+		x += w;
+		if (h > height) {
+			height = h;
+		}
+	}
+
+	ALLEGRO_CONFIG* manifest = al_create_config();
+	char value[255], path[4096];
+	snprintf(value, 255, "%d", count ? page + 1 : 0);
+	al_set_config_value(manifest, "atlas", "pages", value);
+
+	for (int p = 0; p < (count ? page + 1 : 0); p++) {
+		ALLEGRO_BITMAP* bitmap = al_create_bitmap(size, size);
+		al_set_target_bitmap(bitmap);
+		al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+		for (int i = 0; i < count; i++) {
+			if (sprites[i].page == p) {
+				al_draw_bitmap_region(sprites[i].bitmap, sprites[i].ox, sprites[i].oy, sprites[i].w, sprites[i].h, sprites[i].x, sprites[i].y, 0);
+			}
+		}
+		snprintf(path, 4096, "%s/atlas%d.png", output, p);
+		if (!al_save_bitmap(path, bitmap)) {
+			fprintf(stderr, "Could not save %s!\n", path);
+			return 1;
+		}
+		al_destroy_bitmap(bitmap);
+	}
+
+	for (int i = 0; i < count; i++) {
+		struct Sprite* sprite = &sprites[i];
+		int values[] = {sprite->page, sprite->x, sprite->y, sprite->w, sprite->h, sprite->ox, sprite->oy,
+			al_get_bitmap_width(sprite->bitmap), al_get_bitmap_height(sprite->bitmap)};
+		const char* keys[] = {"page", "x", "y", "w", "h", "ox", "oy", "width", "height"};
+		for (int j = 0; j < sizeof(keys) / sizeof(keys[0]); j++) {
+			snprintf(value, 255, "%d", values[j]);
+			al_set_config_value(manifest, sprite->name, keys[j], value);
+		}
+		al_destroy_bitmap(sprite->bitmap);
+		free(sprite->name);
+	}
+
+	snprintf(path, 4096, "%s/atlas.ini", output);
+	if (!al_save_config_file(path, manifest)) {
+		fprintf(stderr, "Could not save %s!\n", path);
+		return 1;
+	}
+	al_destroy_config(manifest);
+	free(sprites);
+
+	printf("Packed %d sprites into %d atlas page(s).\n", count, count ? page + 1 : 0);
+	return 0;
+}
@@ -0,0 +1,133 @@
+/*! \file datapack.c
+ *  \brief Build-time packer that puts the game's data files into a single archive.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Usage: datapack <output file> <data dir> <file relative to the data dir>...
+//
+// Output format (little endian), read by src/pack.c:
+//   "CPAK", u32 file count
+//   for each file, sorted by name: u16 name length, name (without terminator),
+//     u32 offset of the file data from the start of the pack, u32 size in bytes
+//   file data, each one aligned to ALIGNMENT bytes
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ALIGNMENT 16
+
+struct File {
+	const char* name;
+	uint32_t offset, size;
+};
+
+static void Put16(FILE* out, unsigned int value) {
+	fputc(value & 0xff, out);
+	fputc((value >> 8) & 0xff, out);
+}
+
+static void Put32(FILE* out, uint32_t value) {
+	Put16(out, value & 0xffff);
+	Put16(out, value >> 16);
+}
+
+static int CompareFiles(const void* a, const void* b) {
+	const struct File *f1 = a, *f2 = b;
+	return strcmp(f1->name, f2->name);
+}
+
+static FILE* OpenInput(const char* dir, const char* name) {
+	char path[4096];
+	snprintf(path, 4096, "%s/%s", dir, name);
+	FILE* file = fopen(path, "rb");
+	if (!file) {
+		fprintf(stderr, "Could not open %s!\n", path);
+		exit(1);
+	}
+	return file;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s <output file> <data dir> <file>...\n", argv[0]);
+		return 1;
+	}
+
+	const char* dir = argv[2];
+	int count = argc - 3;
+	struct File* files = calloc(count ? count : 1, sizeof(struct File));
+	for (int i = 0; i < count; i++) {
+		files[i].name = argv[i + 3];
+	}
+	qsort(files, count, sizeof(struct File), CompareFiles);
+
+	uint32_t offset = 8;
+	for (int i = 0; i < count; i++) {
+		offset += 2 + strlen(files[i].name) + 8;
+	}
+	for (int i = 0; i < count; i++) {
+		FILE* file = OpenInput(dir, files[i].name);
+		fseek(file, 0, SEEK_END);
+		long size = ftell(file);
+		fclose(file);
+		offset = (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+		files[i].offset = offset;
+		files[i].size = size;
+		offset += size;
+	}
+
+	FILE* out = fopen(argv[1], "wb");
+	if (!out) {
+		fprintf(stderr, "Could not open %s for writing!\n", argv[1]);
+		return 1;
+	}
+	fwrite("CPAK", 1, 4, out);
+	Put32(out, count);
+	for (int i = 0; i < count; i++) {
+		size_t length = strlen(files[i].name);
+		Put16(out, length);
+		fwrite(files[i].name, 1, length, out);
+		Put32(out, files[i].offset);
+		Put32(out, files[i].size);
+	}
+
+	char buffer[65536];
+	for (int i = 0; i < count; i++) {
+		while (ftell(out) < files[i].offset) {
+			fputc(0, out);
+		}
+		FILE* file = OpenInput(dir, files[i].name);
+		size_t read;
+		while ((read = fread(buffer, 1, sizeof(buffer), file))) {
+			fwrite(buffer, 1, read, out);
+		}
+		fclose(file);
+	}
+
+	if (fclose(out)) {
+		fprintf(stderr, "Could not write %s!\n", argv[1]);
+		return 1;
+	}
+	free(files);
+
+	printf("Packed %d files into %u bytes.\n", count, offset);
+	return 0;
+}
@@ -0,0 +1,150 @@
+/*! \file framepack.c
+ *  \brief Build-time encoder of spritesheet animations into delta-encoded frame streams.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Usage: framepack <spritesheet.ini> <output file>
+//
+// Output format (little endian), read by src/framestream.c:
+//   "CSEQ", u16 width, u16 height, u16 frame count, u16 frame duration in ms
+//   for each frame: u32 size of the frame data in bytes, followed by runs of
+//     u16 number of pixels unchanged since the previous frame,
+//     u16 number of changed pixels, followed by their RGB values
+// The first frame is encoded against a black one. Alpha is dropped, so this is
+// only meant for opaque animations.
+
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_image.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_RUN 65535
+
+static void Put16(unsigned char** out, int value) {
+	*(*out)++ = value & 0xff;
+	*(*out)++ = (value >> 8) & 0xff;
+}
+
+static size_t EncodeFrame(const unsigned char* prev, const unsigned char* frame, int pixels, unsigned char* out) {
+	unsigned char* start = out;
+	int i = 0;
+	while (i < pixels) {
+		int skip = 0, copy = 0;
+		while (i + skip < pixels && skip < MAX_RUN && memcmp(prev + (i + skip) * 3, frame + (i + skip) * 3, 3) == 0) {
+			skip++;
+		}
+		while (i + skip + copy < pixels && copy < MAX_RUN && memcmp(prev + (i + skip + copy) * 3, frame + (i + skip + copy) * 3, 3) != 0) {
+			copy++;
+		}
+		Put16(&out, skip);
+		Put16(&out, copy);
+		memcpy(out, frame + (i + skip) * 3, copy * 3);
+		out += copy * 3;
+		i += skip + copy;
+	}
+	return out - start;
+}
+
+int main(int argc, char** argv) {
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s <spritesheet.ini> <output file>\n", argv[0]);
+		return 1;
+	}
+
+	if (!al_init() || !al_init_image_addon()) {
+		fprintf(stderr, "Could not initialize Allegro!\n");
+		return 1;
+	}
+	al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+
+	ALLEGRO_CONFIG* config = al_load_config_file(argv[1]);
+	if (!config) {
+		fprintf(stderr, "Could not load %s!\n", argv[1]);
+		return 1;
+	}
+	const char* value = al_get_config_value(config, "animation", "rows");
+	int rows = value ? atoi(value) : 1;
+	value = al_get_config_value(config, "animation", "cols");
+	int cols = value ? atoi(value) : 1;
+	value = al_get_config_value(config, "animation", "blanks");
+	int blanks = value ? atoi(value) : 0;
+	value = al_get_config_value(config, "animation", "duration");
+	int duration = value ? (int)(atof(value) + 0.5) : 17;
+
+	ALLEGRO_PATH* path = al_create_path(argv[1]);
+	al_set_path_filename(path, al_get_config_value(config, "animation", "file"));
+	ALLEGRO_BITMAP* bitmap = al_load_bitmap(al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP));
+	if (!bitmap) {
+		fprintf(stderr, "Could not load %s!\n", al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP));
+		return 1;
+	}
+	al_destroy_path(path);
+	al_destroy_config(config);
+
+	int width = al_get_bitmap_width(bitmap) / cols, height = al_get_bitmap_height(bitmap) / rows;
+	int count = rows * cols - blanks;
+	int pixels = width * height;
+
+	unsigned char* prev = calloc(pixels, 3);
+	unsigned char* frame = calloc(pixels, 3);
+	// worst case: every pixel changed, with a run header every MAX_RUN pixels
+	unsigned char* encoded = malloc(pixels * 3 + (pixels / MAX_RUN + 2) * 4);
+
+	ALLEGRO_FILE* out = al_fopen(argv[2], "wb");
+	if (!out) {
+		fprintf(stderr, "Could not open %s for writing!\n", argv[2]);
+		return 1;
+	}
+	al_fwrite(out, "CSEQ", 4);
+	al_fwrite16le(out, width);
+	al_fwrite16le(out, height);
+	al_fwrite16le(out, count);
+	al_fwrite16le(out, duration);
+
+	al_lock_bitmap(bitmap, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_READONLY);
+	size_t total = 0;
+	for (int f = 0; f < count; f++) {
+		int ox = (f % cols) * width, oy = (f / cols) * height;
+		for (int y = 0; y < height; y++) {
+			for (int x = 0; x < width; x++) {
+				unsigned char* pixel = frame + (y * width + x) * 3;
+				al_unmap_rgb(al_get_pixel(bitmap, ox + x, oy + y), &pixel[0], &pixel[1], &pixel[2]);
+			}
+		}
+		size_t size = EncodeFrame(prev, frame, pixels, encoded);
+		al_fwrite32le(out, size);
+		al_fwrite(out, encoded, size);
+		total += size;
+
+		unsigned char* tmp = prev;
+		prev = frame;
+		frame = tmp;
+	}
+	al_unlock_bitmap(bitmap);
+
+	al_fclose(out);
+	al_destroy_bitmap(bitmap);
+	free(prev);
+	free(frame);
+	free(encoded);
+
+	printf("Encoded %d frames of %dx%d into %zu bytes.\n", count, width, height, total);
+	return 0;
+}
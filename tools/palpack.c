@@ -0,0 +1,128 @@
+/*! \file palpack.c
+ *  \brief Build-time converter of low-colour images into palette-indexed ones.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Usage: palpack <output dir> <image.png>...
+//
+// Writes <image>.pal into the output dir for every image that uses no more than
+// 256 colours. Output format (little endian), read by src/palette.c:
+//   "CPAL", u16 width, u16 height, u16 number of colours
+//   palette: RGBA value (premultiplied, as loaded by Allegro) of every colour
+//   width * height bytes with palette indices of the pixels, row by row
+// Images with more colours are skipped, the game loads the PNG instead.
+
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_image.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_COLORS 256
+
+static int FindColor(unsigned char* palette, int* count, const unsigned char* rgba) {
+	for (int i = 0; i < *count; i++) {
+		if (memcmp(palette + i * 4, rgba, 4) == 0) {
+			return i;
+		}
+	}
+	if (*count == MAX_COLORS) {
+		return -1;
+	}
+	memcpy(palette + *count * 4, rgba, 4);
+	return (*count)++;
+}
+
+static bool Convert(const char* input, const char* output) {
+	ALLEGRO_BITMAP* bitmap = al_load_bitmap(input);
+	if (!bitmap) {
+		fprintf(stderr, "Could not load %s!\n", input);
+		return false;
+	}
+	int width = al_get_bitmap_width(bitmap), height = al_get_bitmap_height(bitmap);
+	unsigned char palette[MAX_COLORS * 4];
+	unsigned char* indices = malloc(width * height);
+	int count = 0;
+
+	al_lock_bitmap(bitmap, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_READONLY);
+	for (int y = 0; y < height && count >= 0; y++) {
+		for (int x = 0; x < width; x++) {
+			unsigned char rgba[4];
+			al_unmap_rgba(al_get_pixel(bitmap, x, y), &rgba[0], &rgba[1], &rgba[2], &rgba[3]);
+			int index = FindColor(palette, &count, rgba);
+			if (index < 0) {
+				count = -1;
+				break;
+			}
+			indices[y * width + x] = index;
+		}
+	}
+	al_unlock_bitmap(bitmap);
+	al_destroy_bitmap(bitmap);
+
+	if (count < 0) {
+		printf("%s has more than %d colours, skipping.\n", input, MAX_COLORS);
+		free(indices);
+		return true;
+	}
+
+	ALLEGRO_FILE* out = al_fopen(output, "wb");
+	if (!out) {
+		fprintf(stderr, "Could not open %s for writing!\n", output);
+		free(indices);
+		return false;
+	}
+	al_fwrite(out, "CPAL", 4);
+	al_fwrite16le(out, width);
+	al_fwrite16le(out, height);
+	al_fwrite16le(out, count);
+	al_fwrite(out, palette, count * 4);
+	al_fwrite(out, indices, width * height);
+	al_fclose(out);
+	free(indices);
+
+	printf("Converted %s (%dx%d, %d colours).\n", input, width, height, count);
+	return true;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s <output dir> <image.png>...\n", argv[0]);
+		return 1;
+	}
+
+	if (!al_init() || !al_init_image_addon()) {
+		fprintf(stderr, "Could not initialize Allegro!\n");
+		return 1;
+	}
+	al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+
+	for (int i = 2; i < argc; i++) {
+		ALLEGRO_PATH* path = al_create_path(argv[i]);
+		al_set_path_extension(path, ".pal");
+		char output[4096];
+		snprintf(output, 4096, "%s/%s", argv[1], al_get_path_filename(path));
+		al_destroy_path(path);
+
+		if (!Convert(argv[i], output)) {
+			return 1;
+		}
+	}
+	return 0;
+}